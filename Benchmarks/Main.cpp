@@ -0,0 +1,418 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+/*  Benchmarks of the hot paths, printed as JSON so two runs can be compared:
+
+        kernel  Roughness::dissmeasure in ns per pair of partials
+        map     DissonanceMapEngine::update (behind BackgroundVisualisation) in us,
+                after a spectrum/grid change (rebuild) and after one finger moved (move)
+        curve   DissonanceCurveEngine (behind DissonanceCurve) in us, the coarse pass
+                (coarse) and all 1201 cents with the minima (update)
+        field   DissonanceFieldEngine (continuous pitch) in us, the coarse pass
+                after a finger moved (coarse) and the refinement down to every pixel
+                (converged)
+        optimiser  SpectrumAnnealer (the "Optimize" spectrum) in ms until it cooled
+                down, one run from the snapped sawtooth, and its final cost relative
+                to the start
+        audio   VoicePool rendering in us per block
+
+    usage: Benchmarks [--out results.json] [--quick] [--check] [--threads n]
+
+    Every number except the optimiser's is the fastest of 5 batches, which is
+    the most stable one on a busy machine. allocations counts the heap
+    allocations of one steady state call, it has to stay 0: if any is above,
+    the exit code is 1.
+    --check only counts the allocations (times are 0), on fewer grids and with
+    the optimiser stopped after a few rounds, for the ctest of the build.
+    --threads n runs map, curve, field and optimiser on a WorkerPool with n
+    threads besides the calling one (default 0 => everything on the calling
+    thread).
+*/
+
+#define SHADES_DEFINE_ALLOCATION_HOOKS 1
+#include "../Source/AllocationCounter.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../Source/DissonanceMapEngine.h"
+#include "../Source/DissonanceCurveEngine.h"
+#include "../Source/DissonanceFieldEngine.h"
+#include "../Source/SpectrumAnnealer.h"
+#include "../Source/SpectrumPresets.h"
+#include "../Source/VoicePool.h"
+
+namespace
+{
+    const int numberOfIntervals = 10;
+    const int maxNumberOfPartials = 100;
+    double minimumBatchSeconds = 0.01;
+    bool measureTimes = true; //false => only the allocations
+    int maxOptimiserRounds = 1000;
+    long long steadyStateAllocations = 0; //of all measurements => exit code
+
+    struct Measurement
+    {
+        double microseconds;
+        long long allocations;
+    };
+
+    //fastest average of 5 batches, the batches are long enough for the clock
+    template <typename Function>
+    Measurement measure(Function&& function)
+    {
+        using Clock = std::chrono::steady_clock;
+        function(); //warm up, fills the caches of the engines
+
+        AllocationCounter::Scope allocations;
+        function();
+        const long long allocationsPerCall = allocations.getAllocations();
+        steadyStateAllocations += allocationsPerCall;
+        if (! measureTimes)
+            return { 0.0, allocationsPerCall };
+
+        long long iterations = 1;
+        for (;;)
+        {
+            const auto start = Clock::now();
+            for (long long i = 0; i < iterations; i++)
+                function();
+            if (std::chrono::duration<double>(Clock::now() - start).count() >= minimumBatchSeconds)
+                break;
+            iterations *= 2;
+        }
+
+        double best = 1.0e30;
+        for (int batch = 0; batch < 5; batch++)
+        {
+            const auto start = Clock::now();
+            for (long long i = 0; i < iterations; i++)
+                function();
+            best = std::min(best, std::chrono::duration<double, std::micro>(Clock::now() - start).count() / iterations);
+        }
+        return { best, allocationsPerCall };
+    }
+
+    //the sawtooth of the app with numberOfPartials partials
+    void sawtooth(int numberOfPartials, std::vector<float>& partialRatios, std::vector<float>& amplitudes)
+    {
+        std::vector<float> allRatios((size_t)maxNumberOfPartials), allAmplitudes((size_t)maxNumberOfPartials);
+        SpectrumPresets::calculate(SpectrumPresets::sawtooth, numberOfPartials, 12, allRatios, allAmplitudes, [] { return 0.5f; });
+        partialRatios.assign(allRatios.begin(), allRatios.begin() + numberOfPartials);
+        amplitudes.assign(allAmplitudes.begin(), allAmplitudes.begin() + numberOfPartials);
+    }
+
+    void benchmarkKernel(std::FILE* out)
+    {
+        std::fprintf(out, "  \"kernel\": { \"name\": \"%s\", \"results\": [\n", Roughness::getKernelName());
+        const int sizes[] = { 8, 20, 50, 100, 400 };
+        bool first = true;
+        for (int bands : { 16, 0 })
+        {
+            for (bool fast : { false, true })
+            {
+                Roughness::setCriticalBandwidths((float)bands);
+                Roughness::setFastMode(fast);
+                for (int n : sizes)
+                {
+                    //a dense spectrum from 100 Hz to 10 kHz, sorted like the engines hand it over
+                    std::vector<float> frequencies((size_t)n), loudness((size_t)n);
+                    for (int i = 0; i < n; i++)
+                    {
+                        frequencies[i] = 100.0f * std::pow(100.0f, (float)i / n);
+                        loudness[i] = Roughness::loudness(1.0f / (i + 1.0f));
+                    }
+                    volatile float sink = 0.0f;
+                    Measurement m = measure([&] { sink = sink + Roughness::dissmeasure(frequencies.data(), loudness.data(), n); });
+                    const double pairs = n * (n - 1) / 2.0;
+                    std::fprintf(out, "%s    { \"partials\": %d, \"bands\": %d, \"fast\": %s, \"nsPerPair\": %.3f, \"allocations\": %lld }",
+                                 first ? "" : ",\n", n, bands, fast ? "true" : "false", 1000.0 * m.microseconds / pairs, m.allocations);
+                    first = false;
+                }
+            }
+        }
+        Roughness::setCriticalBandwidths(16.0f);
+        Roughness::setFastMode(false);
+        std::fprintf(out, "\n  ] },\n");
+    }
+
+    void benchmarkMap(std::FILE* out, WorkerPool* pool, bool quick)
+    {
+        std::fprintf(out, "  \"map\": [\n");
+        const std::vector<int> partialCounts = quick ? std::vector<int> { 1, 8, 20 } : std::vector<int> { 1, 5, 10, 15, 20 };
+        const std::vector<int> heldCounts = quick ? std::vector<int> { 0, 3, 10 } : std::vector<int> { 0, 1, 2, 5, 10 };
+        bool first = true;
+        for (int notesPerOct : { 12, 31, 53, 120 })
+        {
+            for (int octaves = 1; octaves <= 6; octaves++)
+            {
+                if (! measureTimes && (notesPerOct == 31 || notesPerOct == 53 || (octaves > 1 && octaves < 6)))
+                    continue; //the allocation check only needs the smallest and the largest grids
+                for (int numberOfPartials : partialCounts)
+                {
+                    for (int held : heldCounts)
+                    {
+                        DissonanceMapEngine engine(numberOfIntervals);
+                        engine.setWorkerPool(pool);
+                        engine.prepare(maxNumberOfPartials, 120 * 6);
+                        std::vector<float> partialRatios, amplitudes;
+                        sawtooth(numberOfPartials, partialRatios, amplitudes);
+                        engine.setSpectrum(partialRatios, amplitudes);
+
+                        //held notes spread over the grid like a chord, on grid notes as the fingers are
+                        const int numberOfNotes = notesPerOct * octaves;
+                        std::vector<float> intervals((size_t)numberOfIntervals, -1.0f);
+                        for (int k = 0; k < held; k++)
+                            intervals[k] = std::pow(2.0f, (float)((k * 7 * notesPerOct / 12 + k) % numberOfNotes) / notesPerOct);
+                        engine.setIntervals(intervals);
+
+                        float root = 220.0f;
+                        Measurement rebuild = measure([&] {
+                            root = root == 220.0f ? 220.5f : 220.0f; //=> the cached matrix is stale
+                            engine.setGrid(root, notesPerOct, octaves);
+                            engine.update();
+                        });
+
+                        std::fprintf(out, "%s    { \"notesPerOct\": %d, \"octaves\": %d, \"partials\": %d, \"held\": %d, \"rebuildUs\": %.3f, \"rebuildAllocations\": %lld",
+                                     first ? "" : ",\n", notesPerOct, octaves, numberOfPartials, held, rebuild.microseconds, rebuild.allocations);
+                        first = false;
+                        if (held > 0)
+                        {
+                            const float from = intervals[0];
+                            const float to = std::pow(2.0f, (float)(numberOfNotes / 2) / notesPerOct);
+                            Measurement move = measure([&] {
+                                intervals[0] = intervals[0] == from ? to : from;
+                                engine.setIntervals(intervals);
+                                engine.update();
+                            });
+                            std::fprintf(out, ", \"moveUs\": %.3f, \"moveAllocations\": %lld", move.microseconds, move.allocations);
+                        }
+                        std::fprintf(out, " }");
+                    }
+                }
+            }
+        }
+        std::fprintf(out, "\n  ],\n");
+    }
+
+    void benchmarkCurve(std::FILE* out, WorkerPool* pool)
+    {
+        std::fprintf(out, "  \"curve\": [\n");
+        bool first = true;
+        for (int numberOfPartials : { 1, 5, 10, 15, 20 })
+        {
+            DissonanceCurveEngine engine;
+            engine.setWorkerPool(pool);
+            engine.prepare(maxNumberOfPartials, pool != nullptr ? pool->getNumberOfWorkers() : 1);
+            std::vector<float> partialRatios, amplitudes;
+            sawtooth(numberOfPartials, partialRatios, amplitudes);
+            engine.setSpectrum(partialRatios, amplitudes);
+            engine.setRoot(220.0f);
+            Measurement coarse = measure([&] {
+                engine.restart();
+                engine.refine(0.0);
+            });
+            Measurement m = measure([&] { engine.update(); });
+            std::fprintf(out, "%s    { \"partials\": %d, \"coarseUs\": %.3f, \"updateUs\": %.3f, \"minima\": %d, \"allocations\": %lld }",
+                         first ? "" : ",\n", numberOfPartials, coarse.microseconds, m.microseconds, (int)engine.getMinima().size(),
+                         coarse.allocations + m.allocations);
+            first = false;
+        }
+        std::fprintf(out, "\n  ],\n");
+    }
+
+    void benchmarkField(std::FILE* out, WorkerPool* pool)
+    {
+        std::fprintf(out, "  \"field\": [\n");
+        const int width = 1300;
+        bool first = true;
+        for (int numberOfPartials : { 5, 20, 100 })
+        {
+            for (int held : { 0, 3 })
+            {
+                DissonanceFieldEngine engine(numberOfIntervals);
+                engine.setWorkerPool(pool);
+                engine.prepare(maxNumberOfPartials, width);
+                std::vector<float> partialRatios, amplitudes;
+                sawtooth(numberOfPartials, partialRatios, amplitudes);
+                engine.setSpectrum(partialRatios, amplitudes);
+                engine.setRange(220.0f, 4, width);
+
+                std::vector<float> intervals((size_t)numberOfIntervals, -1.0f);
+                for (int k = 0; k < held; k++)
+                    intervals[k] = engine.getInterval(width * (0.1f + 0.23f * k));
+                intervals[(size_t)numberOfIntervals - 1] = 1.0f; //the finger that moves
+                auto moveFinger = [&] {
+                    intervals[(size_t)numberOfIntervals - 1] = intervals[(size_t)numberOfIntervals - 1] == 1.0f ? 1.001f : 1.0f;
+                    engine.setIntervals(intervals);
+                    engine.restartIfChanged();
+                };
+
+                Measurement coarse = measure([&] {
+                    moveFinger();
+                    engine.refine(0.0);
+                });
+                Measurement converged = measure([&] {
+                    moveFinger();
+                    while (engine.isRefining())
+                        engine.refine(1.0e9);
+                });
+                std::fprintf(out, "%s    { \"partials\": %d, \"held\": %d, \"width\": %d, \"coarseUs\": %.3f, \"convergedUs\": %.3f, \"allocations\": %lld }",
+                             first ? "" : ",\n", numberOfPartials, held + 1, width, coarse.microseconds, converged.microseconds,
+                             coarse.allocations + converged.allocations);
+                first = false;
+            }
+        }
+        std::fprintf(out, "\n  ],\n");
+    }
+
+    //too slow for batches => one run, the rounds have to be allocation free like the analysis
+    void benchmarkOptimiser(std::FILE* out, WorkerPool* pool, bool quick)
+    {
+        std::fprintf(out, "  \"optimiser\": [\n");
+        bool first = true;
+        for (int numberOfPartials : { 8, 20 })
+        {
+            if (quick && numberOfPartials > 8)
+                continue;
+            std::vector<float> partialRatios((size_t)numberOfPartials), amplitudes((size_t)numberOfPartials);
+            SpectrumPresets::calculate(SpectrumPresets::optimised, numberOfPartials, 12, partialRatios, amplitudes, [] { return 0.5f; });
+            SpectrumAnnealer annealer;
+            annealer.setWorkerPool(pool);
+            annealer.start(220.0f, 12, partialRatios.data(), amplitudes.data(), numberOfPartials);
+
+            const auto start = std::chrono::steady_clock::now();
+            AllocationCounter::Scope allocations;
+            while (annealer.getRounds() < maxOptimiserRounds && annealer.round([] { return false; })) {}
+            const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            steadyStateAllocations += allocations.getAllocations();
+            std::fprintf(out, "%s    { \"partials\": %d, \"notesPerOct\": 12, \"ms\": %.1f, \"rounds\": %d, \"cost\": %.4f, \"allocations\": %lld }",
+                         first ? "" : ",\n", numberOfPartials, milliseconds, annealer.getRounds(),
+                         annealer.getCost() / annealer.getStartCost(), allocations.getAllocations());
+            first = false;
+        }
+        std::fprintf(out, "\n  ],\n");
+    }
+
+    void benchmarkAudio(std::FILE* out)
+    {
+        std::fprintf(out, "  \"audio\": [\n");
+        const float sampleRate = 48000.0f;
+        bool first = true;
+        for (bool spectral : { false, true })
+        {
+            for (int numberOfPartials : { 8, 100 })
+            {
+                for (int voices : { 1, 10, 32 })
+                {
+                    for (int blockSize : { 64, 256, 1024 })
+                    {
+                        VoicePool voicePool;
+                        voicePool.prepare(32, 32, maxNumberOfPartials, sampleRate);
+                        SpectralSynth spectralSynth;
+                        spectralSynth.setNumberOfOscillators(32 * maxNumberOfPartials);
+                        spectralSynth.setSampleRate(sampleRate);
+                        std::vector<float> partialRatios((size_t)maxNumberOfPartials), amplitudes((size_t)maxNumberOfPartials);
+                        SpectrumPresets::calculate(SpectrumPresets::sawtooth, numberOfPartials, 12, partialRatios, amplitudes, [] { return 0.5f; });
+                        const float level = SpectrumPresets::calculateLevel(amplitudes, numberOfPartials, voices);
+                        for (auto& amplitude : amplitudes)
+                            amplitude *= level;
+                        for (int v = 0; v < voices; v++)
+                            voicePool.setFingerFrequency(v, 55.0f * std::pow(2.0f, v / 7.0f));
+
+                        std::vector<float> output((size_t)blockSize), scratch((size_t)blockSize);
+                        Measurement m = measure([&] {
+                            std::fill(output.begin(), output.end(), 0.0f);
+                            if (spectral)
+                            {
+                                voicePool.renderSpectral(spectralSynth, blockSize, partialRatios.data(), amplitudes.data(), numberOfPartials);
+                                spectralSynth.render(output.data(), blockSize);
+                            }
+                            else
+                            {
+                                voicePool.render(output.data(), scratch.data(), blockSize, partialRatios.data(), amplitudes.data(), numberOfPartials);
+                            }
+                        });
+                        std::fprintf(out, "%s    { \"synthesis\": \"%s\", \"partials\": %d, \"voices\": %d, \"blockSize\": %d, \"usPerBlock\": %.3f, \"realtimeLoad\": %.5f, \"allocations\": %lld }",
+                                     first ? "" : ",\n", spectral ? "ifft" : "oscillator", numberOfPartials, voices, blockSize,
+                                     m.microseconds, m.microseconds * 1.0e-6 * sampleRate / blockSize, m.allocations);
+                        first = false;
+                    }
+                }
+            }
+        }
+        std::fprintf(out, "\n  ]\n");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string outName;
+    bool quick = false;
+    bool check = false;
+    int numberOfThreads = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--out" && i + 1 < argc)
+            outName = argv[++i];
+        else if (argument == "--quick")
+            quick = true;
+        else if (argument == "--check")
+            quick = check = true;
+        else if (argument == "--threads" && i + 1 < argc)
+            numberOfThreads = std::max(0, std::atoi(argv[++i]));
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--out results.json] [--quick] [--check] [--threads n]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::FILE* out = outName.empty() ? stdout : std::fopen(outName.c_str(), "w");
+    if (out == nullptr)
+    {
+        std::fprintf(stderr, "can't write %s\n", outName.c_str());
+        return 1;
+    }
+    if (quick)
+        minimumBatchSeconds = 0.002;
+    if (check)
+    {
+        measureTimes = false;
+        maxOptimiserRounds = 2;
+    }
+
+    AllocationCounter::watchCurrentThread(true);
+    std::unique_ptr<WorkerPool> pool(numberOfThreads > 0 ? new WorkerPool(numberOfThreads) : nullptr);
+
+    std::fprintf(out, "{\n  \"threads\": %d,\n", numberOfThreads);
+    benchmarkKernel(out);
+    benchmarkMap(out, pool.get(), quick);
+    benchmarkCurve(out, pool.get());
+    benchmarkField(out, pool.get());
+    benchmarkOptimiser(out, pool.get(), quick);
+    benchmarkAudio(out);
+    std::fprintf(out, "}\n");
+
+    if (out != stdout)
+        std::fclose(out);
+    if (steadyStateAllocations > 0)
+    {
+        std::fprintf(stderr, "%lld heap allocations in steady state calls, see the allocations entries\n", steadyStateAllocations);
+        return 1;
+    }
+    return 0;
+}
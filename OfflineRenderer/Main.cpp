@@ -0,0 +1,281 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+/*  Offline renderer: plays a script of touches through the same voices as
+    the app, without audio device, touch screen or JUCE, writes a WAV file and
+    prints how many times faster than real time it rendered.
+
+    usage: OfflineRenderer script.txt [--out out.wav] [--rate 48000] [--block 256] [--ifft]
+
+    Every line of the script is "<time in s> <command> <arguments>", # starts a
+    comment:
+        spectrum sawtooth|square|triangle|random|equal  (default sawtooth)
+        partials <number of partials>                  (default 8)
+        notesPerOct <notes per octave>                 (for the equal spectrum, default 120)
+        down <finger> <Hz>
+        move <finger> <Hz>
+        up <finger>
+        glide <finger> <from Hz> <to Hz> <duration in s>   (a drag, one move every 10 ms)
+        chord <duration in s> <Hz> <Hz> ...                (fingers 0, 1, ... down and up again)
+        end                                                (length, default 1 s after the last line)
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../Source/VoicePool.h"
+#include "../Source/SpectrumPresets.h"
+
+namespace
+{
+    const int maxNumberOfPartials = 100;
+    const int numberOfVoices = 32;
+    const int numberOfFingers = 10;
+
+    enum class Command { finger, spectrum, partials, notesPerOct, end };
+
+    struct Event
+    {
+        double time;
+        Command command;
+        int finger;
+        float value;
+    };
+
+    bool parseScript(const std::string& fileName, std::vector<Event>& events)
+    {
+        std::ifstream file(fileName);
+        if (! file)
+        {
+            std::fprintf(stderr, "can't read %s\n", fileName.c_str());
+            return false;
+        }
+
+        std::string line;
+        for (int lineNumber = 1; std::getline(file, line); lineNumber++)
+        {
+            line = line.substr(0, line.find('#'));
+            std::istringstream words(line);
+            double time;
+            std::string command;
+            if (! (words >> time))
+                continue; //empty or comment
+
+            words >> command;
+            bool ok = true;
+            if (command == "down" || command == "move")
+            {
+                int finger; float frequency;
+                ok = (bool)(words >> finger >> frequency);
+                events.push_back({ time, Command::finger, finger, frequency });
+            }
+            else if (command == "up")
+            {
+                int finger;
+                ok = (bool)(words >> finger);
+                events.push_back({ time, Command::finger, finger, 0.0f });
+            }
+            else if (command == "glide")
+            {
+                int finger; float from, to; double duration;
+                ok = (bool)(words >> finger >> from >> to >> duration);
+                const int steps = std::max(1, (int)(duration / 0.01));
+                for (int step = 0; ok && step <= steps; step++)
+                    events.push_back({ time + duration * step / steps, Command::finger, finger, from * std::pow(to / from, (float)step / steps) });
+            }
+            else if (command == "chord")
+            {
+                double duration; float frequency;
+                ok = (bool)(words >> duration);
+                for (int finger = 0; ok && words >> frequency; finger++)
+                {
+                    events.push_back({ time, Command::finger, finger, frequency });
+                    events.push_back({ time + duration, Command::finger, finger, 0.0f });
+                }
+            }
+            else if (command == "spectrum")
+            {
+                std::string name;
+                ok = (bool)(words >> name);
+                const char* names[] = { "sawtooth", "square", "triangle", "random", "equal" };
+                int id = (int)(std::find(names, names + 5, name) - names) + 1;
+                ok = ok && id <= 5;
+                events.push_back({ time, Command::spectrum, 0, (float)id });
+            }
+            else if (command == "partials" || command == "notesPerOct")
+            {
+                int value;
+                ok = (bool)(words >> value) && value > 0;
+                events.push_back({ time, command == "partials" ? Command::partials : Command::notesPerOct, 0, (float)value });
+            }
+            else if (command == "end")
+            {
+                events.push_back({ time, Command::end, 0, 0.0f });
+            }
+            else
+            {
+                ok = false;
+            }
+
+            if (! ok)
+            {
+                std::fprintf(stderr, "%s:%d: can't parse \"%s\"\n", fileName.c_str(), lineNumber, line.c_str());
+                return false;
+            }
+        }
+        std::stable_sort(events.begin(), events.end(), [](const Event& a, const Event& b) { return a.time < b.time; });
+        return true;
+    }
+
+    //mono, 32 bit float
+    bool writeWav(const std::string& fileName, const std::vector<float>& samples, int sampleRate)
+    {
+        std::ofstream file(fileName, std::ios::binary);
+        auto write32 = [&](uint32_t value) { file.write(reinterpret_cast<const char*>(&value), 4); };
+        auto write16 = [&](uint16_t value) { file.write(reinterpret_cast<const char*>(&value), 2); };
+        const uint32_t dataSize = (uint32_t)(samples.size() * sizeof(float));
+        file.write("RIFF", 4);
+        write32(36 + dataSize);
+        file.write("WAVEfmt ", 8);
+        write32(16);
+        write16(3); //IEEE float
+        write16(1);
+        write32((uint32_t)sampleRate);
+        write32((uint32_t)sampleRate * 4);
+        write16(4);
+        write16(32);
+        file.write("data", 4);
+        write32(dataSize);
+        file.write(reinterpret_cast<const char*>(samples.data()), dataSize);
+        return (bool)file;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string scriptName, outName = "out.wav";
+    int sampleRate = 48000;
+    int blockSize = 256;
+    bool spectral = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument == "--out" && i + 1 < argc)
+            outName = argv[++i];
+        else if (argument == "--rate" && i + 1 < argc)
+            sampleRate = std::atoi(argv[++i]);
+        else if (argument == "--block" && i + 1 < argc)
+            blockSize = std::atoi(argv[++i]);
+        else if (argument == "--ifft")
+            spectral = true;
+        else if (scriptName.empty() && argument[0] != '-')
+            scriptName = argument;
+        else
+            scriptName.clear(), i = argc;
+    }
+    if (scriptName.empty() || sampleRate <= 0 || blockSize <= 0)
+    {
+        std::fprintf(stderr, "usage: %s script.txt [--out out.wav] [--rate 48000] [--block 256] [--ifft]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<Event> events;
+    if (! parseScript(scriptName, events))
+        return 1;
+
+    double length = events.empty() ? 1.0 : events.back().time + 1.0;
+    for (const Event& event : events)
+        if (event.command == Command::end)
+            length = event.time;
+
+    //everything the app prepares before the audio starts
+    VoicePool voicePool;
+    voicePool.prepare(numberOfVoices, numberOfFingers, maxNumberOfPartials, (float)sampleRate);
+    SpectralSynth spectralSynth;
+    spectralSynth.setNumberOfOscillators(numberOfVoices * maxNumberOfPartials);
+    spectralSynth.setSampleRate((float)sampleRate);
+    std::vector<float> partialRatios((size_t)maxNumberOfPartials), amplitudes((size_t)maxNumberOfPartials), levelAmplitudes((size_t)maxNumberOfPartials);
+    std::vector<float> scratch((size_t)blockSize);
+    std::vector<float> output((size_t)(length * sampleRate) / (size_t)blockSize * (size_t)blockSize + (size_t)blockSize, 0.0f);
+    std::mt19937 random(1); //the same random spectrum every run
+    std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+    int spectrumId = SpectrumPresets::sawtooth, numberOfPartials = 8, notesPerOct = 120;
+
+    auto calculateSpectrum = [&]
+    {
+        SpectrumPresets::calculate(spectrumId, numberOfPartials, notesPerOct, partialRatios, amplitudes, [&] { return distribution(random); });
+        const float level = SpectrumPresets::calculateLevel(amplitudes, numberOfPartials, numberOfFingers);
+        for (int partial = 0; partial < maxNumberOfPartials; partial++)
+            levelAmplitudes[partial] = level * amplitudes[partial];
+    };
+    calculateSpectrum();
+
+    //same order as getNextAudioBlock(): render up to every event, then apply it
+    const auto start = std::chrono::steady_clock::now();
+    size_t nextEvent = 0;
+    for (size_t blockStart = 0; blockStart < output.size(); blockStart += (size_t)blockSize)
+    {
+        float* block = output.data() + blockStart;
+        int position = 0;
+        for (; nextEvent < events.size() && events[nextEvent].time * sampleRate < (double)(blockStart + (size_t)blockSize); nextEvent++)
+        {
+            const Event& event = events[nextEvent];
+            const int offset = std::max(position, (int)(event.time * sampleRate - (double)blockStart));
+            if (! spectral)
+                voicePool.render(block + position, scratch.data(), offset - position, partialRatios.data(), levelAmplitudes.data(), numberOfPartials);
+            position = offset;
+
+            if (event.command == Command::finger)
+                voicePool.setFingerFrequency(event.finger, event.value);
+            else if (event.command == Command::spectrum)
+                spectrumId = (int)event.value, calculateSpectrum();
+            else if (event.command == Command::partials)
+                numberOfPartials = std::min(maxNumberOfPartials, (int)event.value), calculateSpectrum();
+            else if (event.command == Command::notesPerOct)
+                notesPerOct = (int)event.value, calculateSpectrum();
+        }
+
+        if (spectral)
+        {
+            voicePool.renderSpectral(spectralSynth, blockSize, partialRatios.data(), levelAmplitudes.data(), numberOfPartials);
+            spectralSynth.render(block, blockSize);
+        }
+        else
+        {
+            voicePool.render(block + position, scratch.data(), blockSize - position, partialRatios.data(), levelAmplitudes.data(), numberOfPartials);
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    output.resize((size_t)(length * sampleRate));
+    float peak = 0.0f;
+    for (float sample : output)
+        peak = std::max(peak, std::abs(sample));
+    if (! writeWav(outName, output, sampleRate))
+    {
+        std::fprintf(stderr, "can't write %s\n", outName.c_str());
+        return 1;
+    }
+
+    const double audioSeconds = (double)output.size() / sampleRate;
+    std::printf("%s: %.2f s at %d Hz, block %d, %s synthesis, peak %.3f\n", outName.c_str(), audioSeconds, sampleRate, blockSize,
+                spectral ? "IFFT" : "oscillator", peak);
+    std::printf("rendered in %.3f s = %.1f x real time\n", seconds, audioSeconds / std::max(seconds, 1.0e-9));
+    return 0;
+}
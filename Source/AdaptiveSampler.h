@@ -0,0 +1,203 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+/*  Coarse-to-fine sampling of a function on the points 0 ... size - 1, shared
+    by DissonanceFieldEngine and DissonanceCurveEngine.
+
+    Every coarseStep-th point (and the last one) is sampled first. Then the
+    segments between known samples are split at their midpoint, the most urgent
+    first: width * (rise over the segment relative to the range so far + a bonus
+    next to a local minimum + 1 / coarseStep). So the dips and the steep flanks
+    get sharp first and the rest follows until every point is known. Between
+    two refine() calls the function is interpolated linearly.
+*/
+class AdaptiveSampler
+{
+public:
+    //reserves everything, so restart() and refine() don't allocate up to this size
+    void prepare(int maxSize)
+    {
+        samples.reserve((size_t)maxSize);
+        leftNeighbour.reserve((size_t)maxSize);
+        rightNeighbour.reserve((size_t)maxSize);
+        segments.reserve((size_t)maxSize);
+        points.reserve((size_t)maxSize);
+        values.reserve((size_t)maxSize);
+        pending.reserve((size_t)maxSize);
+    }
+
+    //forgets all samples, the next refine() starts with the coarse ones
+    void restart(int newSize, int newCoarseStep)
+    {
+        size = std::max(0, newSize);
+        coarseStep = std::max(1, newCoarseStep);
+        samples.assign((size_t)size, 0.0f);
+        leftNeighbour.assign((size_t)size, -1);
+        rightNeighbour.assign((size_t)size, -1);
+        segments.clear();
+        numberOfKnownSamples = 0;
+        coarseDone = size == 0;
+    }
+
+    //no more refinement until the next restart()
+    void stop()
+    {
+        segments.clear();
+        coarseDone = true;
+    }
+
+    bool isRefining() const { return ! coarseDone || ! segments.empty(); }
+    int getSize() const { return size; }
+    int getNumberOfKnownSamples() const { return numberOfKnownSamples; }
+
+    //evaluate(points, values, n) computes the function at n points, the coarse ones are always done at once
+    template <typename Evaluate>
+    void refine(double milliseconds, int batchSize, Evaluate&& evaluate)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        if (! coarseDone)
+        {
+            points.clear();
+            for (int x = 0; x < size; x += coarseStep)
+                points.push_back(x);
+            if ((size - 1) % coarseStep != 0)
+                points.push_back(size - 1);
+            values.resize(points.size());
+            evaluate(points.data(), values.data(), (int)points.size());
+
+            minValue = maxValue = values[0];
+            for (size_t p = 0; p < points.size(); p++)
+            {
+                samples[points[p]] = values[p];
+                minValue = std::min(minValue, values[p]);
+                maxValue = std::max(maxValue, values[p]);
+                if (p > 0)
+                {
+                    leftNeighbour[points[p]] = points[p - 1];
+                    rightNeighbour[points[p - 1]] = points[p];
+                }
+            }
+            numberOfKnownSamples = (int)points.size();
+            for (size_t p = 1; p < points.size(); p++)
+                pushSegment(points[p - 1], points[p]);
+            coarseDone = true;
+        }
+
+        //the most urgent segments are split in batches, so evaluate() gets enough points to spread over threads
+        batchSize = std::max(1, batchSize);
+        while (! segments.empty()
+               && std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() < milliseconds)
+        {
+            pending.clear();
+            points.clear();
+            while (! segments.empty() && (int)pending.size() < batchSize)
+            {
+                std::pop_heap(segments.begin(), segments.end());
+                pending.push_back(segments.back());
+                segments.pop_back();
+                points.push_back((pending.back().left + pending.back().right) / 2);
+            }
+            values.resize(points.size());
+            evaluate(points.data(), values.data(), (int)points.size());
+
+            for (size_t p = 0; p < pending.size(); p++)
+            {
+                const int m = points[p];
+                samples[m] = values[p];
+                leftNeighbour[m] = pending[p].left;
+                rightNeighbour[m] = pending[p].right;
+                rightNeighbour[pending[p].left] = m;
+                leftNeighbour[pending[p].right] = m;
+                minValue = std::min(minValue, values[p]);
+                maxValue = std::max(maxValue, values[p]);
+            }
+            numberOfKnownSamples += (int)pending.size();
+            for (size_t p = 0; p < pending.size(); p++)
+            {
+                pushSegment(pending[p].left, points[p]);
+                pushSegment(points[p], pending[p].right);
+            }
+        }
+    }
+
+    //size values, known samples joined by straight lines
+    void interpolate(float* output) const
+    {
+        if (size == 0 || numberOfKnownSamples == 0)
+            return;
+        int x = 0;
+        for (; rightNeighbour[x] >= 0; x = rightNeighbour[x])
+        {
+            const int right = rightNeighbour[x];
+            for (int i = x; i < right; i++)
+                output[i] = samples[x] + (samples[right] - samples[x]) * (i - x) / (right - x);
+        }
+        std::fill(output + x, output + size, samples[x]);
+    }
+
+    //the known samples from left to right: 0, getNext(0), ... until -1
+    int getNext(int x) const { return rightNeighbour[x]; }
+    int getPrevious(int x) const { return leftNeighbour[x]; }
+    float getSample(int x) const { return samples[x]; }
+
+    //not higher than the known samples next to it
+    bool isLocalMinimum(int x) const
+    {
+        return (leftNeighbour[x] < 0 || samples[x] <= samples[leftNeighbour[x]])
+            && (rightNeighbour[x] < 0 || samples[x] <= samples[rightNeighbour[x]]);
+    }
+
+private:
+    static constexpr float minimumBonus = 0.5f;
+
+    struct Segment
+    {
+        float priority;
+        int left;
+        int right;
+
+        bool operator<(const Segment& other) const { return priority < other.priority; }
+    };
+
+    //only if there is a point between left and right
+    void pushSegment(int left, int right)
+    {
+        if (right - left < 2)
+            return;
+        const float range = std::max(maxValue - minValue, 1.0e-9f);
+        const float rise = std::abs(samples[right] - samples[left]) / range;
+        const float minimum = isLocalMinimum(left) || isLocalMinimum(right) ? minimumBonus : 0.0f;
+        segments.push_back({ (right - left) * (rise + minimum + 1.0f / coarseStep), left, right });
+        std::push_heap(segments.begin(), segments.end());
+    }
+
+    int size = 0;
+    int coarseStep = 1;
+    std::vector<float> samples;
+    std::vector<int> leftNeighbour;
+    std::vector<int> rightNeighbour;
+    std::vector<Segment> segments; //max-heap on priority
+    std::vector<Segment> pending;
+    std::vector<int> points;
+    std::vector<float> values;
+    float minValue = 0.0f;
+    float maxValue = 0.0f;
+    int numberOfKnownSamples = 0;
+    bool coarseDone = true;
+};
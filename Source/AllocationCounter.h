@@ -0,0 +1,98 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/*  Counts heap allocations made on watched threads (the analysis thread and the
+    WorkerPool threads), so a steady state update can check that it allocated
+    nothing.
+
+    The counting operator new/delete are only compiled into the one translation
+    unit which defines SHADES_DEFINE_ALLOCATION_HOOKS before including this file
+    (Main.cpp in debug builds). Without them the count simply stays 0.
+    Aligned allocations (alignas > new's default) are not counted.
+*/
+class AllocationCounter
+{
+public:
+    static void watchCurrentThread(bool shouldWatch) noexcept { getWatched() = shouldWatch; }
+
+    static long long getCount() noexcept { return getTotal().load(std::memory_order_relaxed); }
+
+    static void countAllocation() noexcept
+    {
+        if (getWatched())
+            getTotal().fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //allocations on watched threads since construction
+    class Scope
+    {
+    public:
+        Scope() noexcept : start(getCount()) {}
+        long long getAllocations() const noexcept { return getCount() - start; }
+
+    private:
+        long long start;
+    };
+
+private:
+    static bool& getWatched() noexcept
+    {
+        static thread_local bool watched = false;
+        return watched;
+    }
+
+    static std::atomic<long long>& getTotal() noexcept
+    {
+        static std::atomic<long long> total { 0 };
+        return total;
+    }
+};
+
+#if SHADES_DEFINE_ALLOCATION_HOOKS
+#if defined(__GNUC__) && ! defined(__clang__)
+ #pragma GCC diagnostic push
+ #pragma GCC diagnostic ignored "-Wmismatched-new-delete" //new and delete below are a matching malloc/free pair
+#endif
+void* operator new(std::size_t size)
+{
+    AllocationCounter::countAllocation();
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    AllocationCounter::countAllocation();
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+#if defined(__GNUC__) && ! defined(__clang__)
+ #pragma GCC diagnostic pop
+#endif
+#endif
@@ -0,0 +1,143 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+/*  How long the audio callback takes compared to its deadline (the duration of
+    the block).
+
+    The audio thread reads the clock and counts the block in a histogram of
+    relaxed atomics with logarithmic bins (bandsPerOctave per doubling, so a
+    percentile is accurate to about 9 %), wait-free and without a queue that
+    someone has to empty: nothing runs on the message thread unless the stats
+    are read. A block that takes longer than its own duration counts as a
+    missed deadline.
+*/
+class AudioCallbackStats
+{
+public:
+    static const int bandsPerOctave = 8;
+
+    //audio thread: measures from construction to destruction, e.g. one whole getNextAudioBlock()
+    class Scope
+    {
+    public:
+        Scope(AudioCallbackStats& owner, int numSamples, double sampleRate) noexcept
+            : owner(owner),
+              budget(sampleRate > 0.0 ? 1.0e6 * numSamples / sampleRate : 0.0),
+              start(Clock::now()) {}
+
+        ~Scope() { owner.blockDone(std::chrono::duration<double, std::micro>(Clock::now() - start).count(), budget); }
+
+    private:
+        AudioCallbackStats& owner;
+        const double budget;
+        const std::chrono::steady_clock::time_point start;
+    };
+
+    AudioCallbackStats() { reset(); }
+
+    //audio thread, both in us
+    void blockDone(double microseconds, double blockBudget) noexcept
+    {
+        if (blockBudget > 0.0 && microseconds > blockBudget)
+            deadlineMisses.fetch_add(1, std::memory_order_relaxed);
+        histogram[getBin((float)microseconds)].fetch_add(1, std::memory_order_relaxed);
+        numberOfBlocks.fetch_add(1, std::memory_order_relaxed);
+        double max = maxMicroseconds.load(std::memory_order_relaxed);
+        while (microseconds > max && ! maxMicroseconds.compare_exchange_weak(max, microseconds, std::memory_order_relaxed)) {}
+        budget.store(blockBudget, std::memory_order_relaxed);
+    }
+
+    //while no audio runs
+    void reset() noexcept
+    {
+        for (auto& bin : histogram)
+            bin.store(0, std::memory_order_relaxed);
+        numberOfBlocks.store(0, std::memory_order_relaxed);
+        maxMicroseconds.store(0.0, std::memory_order_relaxed);
+    }
+
+    //any thread (everything below), the numbers may be a few blocks apart from each other
+    long long getNumberOfBlocks() const noexcept { return numberOfBlocks.load(std::memory_order_relaxed); }
+    int getDeadlineMisses() const noexcept { return deadlineMisses.load(std::memory_order_relaxed); }
+    double getMaxMicroseconds() const noexcept { return maxMicroseconds.load(std::memory_order_relaxed); }
+    double getBudgetMicroseconds() const noexcept { return budget.load(std::memory_order_relaxed); }
+
+    //upper edge of the bin that holds the given fraction (0...1) of the blocks
+    double getPercentile(double fraction) const noexcept
+    {
+        const long long blocks = getNumberOfBlocks();
+        if (blocks == 0)
+            return 0.0;
+        const long long rank = std::max(1LL, (long long)std::ceil(fraction * blocks));
+        long long count = 0;
+        for (int bin = 0; bin < numberOfBins; bin++)
+        {
+            count += histogram[bin].load(std::memory_order_relaxed);
+            if (count >= rank)
+                return std::min(getUpperEdge(bin), getMaxMicroseconds());
+        }
+        return getMaxMicroseconds();
+    }
+
+    //xruns are counted by the audio device, so the caller passes them in (-1 => unknown)
+    std::string toJson(int xruns) const
+    {
+        char line[256];
+        std::snprintf(line, sizeof(line), "{\n  \"blocks\": %lld,\n  \"budgetUs\": %.1f,\n  \"p50Us\": %.1f,\n  \"p99Us\": %.1f,\n  \"maxUs\": %.1f,\n"
+                                          "  \"deadlineMisses\": %d,\n  \"xruns\": %d,\n  \"histogram\": [",
+                      getNumberOfBlocks(), getBudgetMicroseconds(), getPercentile(0.5), getPercentile(0.99), getMaxMicroseconds(), getDeadlineMisses(), xruns);
+        std::string json = line;
+        bool first = true;
+        for (int bin = 0; bin < numberOfBins; bin++)
+        {
+            const long long blocks = histogram[bin].load(std::memory_order_relaxed);
+            if (blocks == 0)
+                continue;
+            std::snprintf(line, sizeof(line), "%s\n    { \"upToUs\": %.2f, \"blocks\": %lld }", first ? "" : ",", getUpperEdge(bin), blocks);
+            json += line;
+            first = false;
+        }
+        return json + "\n  ]\n}\n";
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static_assert(std::atomic<double>::is_always_lock_free, "the audio thread must not take a lock");
+
+    static const int lowestOctave = -4; //1/16 us
+    static const int numberOfBins = 24 * bandsPerOctave; //up to 2^20 us = 1 s
+
+    static int getBin(float microseconds) noexcept
+    {
+        if (! (microseconds > 0.0f))
+            return 0;
+        const int bin = (int)std::ceil((std::log2(microseconds) - lowestOctave) * bandsPerOctave);
+        return std::min(std::max(bin, 0), numberOfBins - 1);
+    }
+
+    static double getUpperEdge(int bin) noexcept { return std::exp2((double)bin / bandsPerOctave + lowestOctave); }
+
+    std::atomic<int> deadlineMisses { 0 };
+    std::atomic<long long> histogram[numberOfBins];
+    std::atomic<long long> numberOfBlocks { 0 };
+    std::atomic<double> maxMicroseconds { 0.0 };
+    std::atomic<double> budget { 0.0 };
+};
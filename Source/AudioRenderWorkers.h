@@ -0,0 +1,238 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*  Fork/join for the audio callback on a few real-time threads.
+
+    Unlike WorkerPool nothing here takes a lock or makes a system call on the
+    audio thread. While enabled the workers spin on the job counters for a
+    while after each job (and sleep for a millisecond when nothing comes), so a
+    fork costs a few atomic stores. Items are claimed one by one with a
+    compare-and-swap, the audio thread claims them as well: a worker that isn't
+    scheduled in time just gets nothing, its items are rendered by the others.
+    Each worker adds into its own buffer, the audio thread sums them up at the
+    end.
+    The audio thread can't take over an item a worker has already started, so
+    it waits for that one. If it has to wait past the deadline, the workers are
+    parked and the audio thread renders alone until setEnabled(true) is called
+    again.
+*/
+class AudioRenderWorkers
+{
+public:
+    //numberOfThreads besides the audio thread
+    explicit AudioRenderWorkers(int numberOfThreads)
+    {
+        for (int i = 1; i <= numberOfThreads; i++)
+            workers.emplace_back(new Worker(*this, i));
+        for (auto& worker : workers)
+            worker->start();
+    }
+
+    ~AudioRenderWorkers()
+    {
+        enabled = false;
+        for (auto& worker : workers)
+        {
+            worker->signalThreadShouldExit();
+            worker->notify();
+        }
+        for (auto& worker : workers)
+            worker->stopThread(2000);
+    }
+
+    int getNumberOfWorkers() const noexcept { return (int)workers.size() + 1; }
+
+    //allocates, call while the audio is stopped: the workers are parked meanwhile, as they may still be spinning
+    void prepare(int maxBlockSize)
+    {
+        const bool wasEnabled = enabled.exchange(false);
+        while (busyWorkers.load() != 0)
+            std::this_thread::yield();
+
+        maxSamples = std::max(1, maxBlockSize);
+        buffers.assign((size_t)getNumberOfWorkers(), std::vector<float>((size_t)maxSamples, 0.0f));
+        scratch.assign((size_t)getNumberOfWorkers(), std::vector<float>((size_t)maxSamples, 0.0f));
+
+        if (wasEnabled)
+        {
+            enabled = true;
+            for (auto& worker : workers)
+                worker->notify();
+        }
+    }
+
+    int getMaxBlockSize() const noexcept { return maxSamples; }
+
+    //message thread, also clears a fallback after a missed deadline
+    void setEnabled(bool shouldBeEnabled)
+    {
+        enabled = shouldBeEnabled;
+        fallback = false;
+        if (shouldBeEnabled)
+            for (auto& worker : workers)
+                worker->notify();
+    }
+
+    bool isEnabled() const noexcept { return enabled.load(std::memory_order_relaxed); }
+
+    //enabled, but back to one thread after a missed deadline
+    bool isFallingBack() const noexcept { return fallback.load(std::memory_order_relaxed); }
+
+    int getNumberOfMissedDeadlines() const noexcept { return missedDeadlines.load(std::memory_order_relaxed); }
+
+    //audio thread only: calls body(item, output, scratch) for every item in [0, numberOfItems), adding to output
+    //numSamples <= getMaxBlockSize(), deadline in ms of juce::Time::getMillisecondCounterHiRes()
+    template <typename Body>
+    void forkJoin(int numberOfItems, float* output, int numSamples, double deadline, Body&& body) noexcept
+    {
+        jassert(numSamples <= maxSamples);
+        if (! isSpinning() || numberOfItems < 2 || buffers.empty())
+        {
+            for (int item = 0; item < numberOfItems; item++)
+                body(item, output, scratch.empty() ? nullptr : scratch[0].data());
+            return;
+        }
+
+        for (size_t w = 1; w < buffers.size(); w++)
+            std::fill(buffers[w].begin(), buffers[w].begin() + numSamples, 0.0f);
+        currentBody = &body;
+        invoke = [](void* b, int item, float* out, float* s) { (*static_cast<std::remove_reference_t<Body>*>(b))(item, out, s); };
+        const long long begin = tickets.next.load();
+        jobBegin = begin;
+        tickets.end.store(begin + numberOfItems); //=> the workers see the job
+
+        work(0, output);
+
+        bool missed = false;
+        while (busyWorkers.load() != 0)
+        {
+            if (! missed && juce::Time::getMillisecondCounterHiRes() > deadline)
+                missed = true;
+        }
+        if (missed)
+        {
+            fallback = true;
+            missedDeadlines++;
+        }
+
+        for (size_t w = 1; w < buffers.size(); w++)
+        {
+            const float* buffer = buffers[w].data();
+            for (int sample = 0; sample < numSamples; sample++)
+                output[sample] += buffer[sample];
+        }
+    }
+
+private:
+    class Worker : public juce::Thread
+    {
+    public:
+        Worker(AudioRenderWorkers& owner, int index)
+            : juce::Thread("Audio Render " + juce::String(index)), owner(owner), index(index) {}
+
+        void start()
+        {
+#if JUCE_MAJOR_VERSION > 7 || (JUCE_MAJOR_VERSION == 7 && (JUCE_MINOR_VERSION > 0 || JUCE_BUILDNUMBER >= 3))
+            startRealtimeThread(juce::Thread::RealtimeOptions{});
+#else
+            startThread(10);
+#endif
+        }
+
+        void run() override
+        {
+            int idleSpins = 0;
+            while (! threadShouldExit())
+            {
+                if (! owner.isSpinning())
+                {
+                    wait(-1);
+                }
+                else if (owner.work(index, nullptr))
+                {
+                    idleSpins = 0;
+                }
+                else if (++idleSpins < spinsBeforeSleeping)
+                {
+                    std::this_thread::yield();
+                }
+                else //no audio for a while, don't keep a real-time thread busy
+                {
+                    wait(1);
+                    idleSpins = 0;
+                }
+            }
+        }
+
+    private:
+        static const int spinsBeforeSleeping = 20000;
+
+        AudioRenderWorkers& owner;
+        const int index;
+    };
+
+    bool isSpinning() const noexcept { return enabled.load(std::memory_order_relaxed) && ! fallback.load(std::memory_order_relaxed); }
+
+    //claims items of the current job until there are none left, returns false if there were none
+    //output nullptr => the worker's own buffer, only looked up with a claimed item, when prepare() can't run
+    bool work(int worker, float* output) noexcept
+    {
+        if (tickets.next.load() >= tickets.end.load()) //only reads while idle, the audio thread's wait for busyWorkers == 0 isn't disturbed
+            return false;
+
+        busyWorkers++; //before claiming => the audio thread waits for everything claimed from here on
+        bool claimed = false;
+        const long long end = tickets.end.load();
+        long long ticket = tickets.next.load();
+        while (ticket < end)
+        {
+            if (tickets.next.compare_exchange_weak(ticket, ticket + 1))
+            {
+                invoke(currentBody, (int)(ticket - jobBegin), output != nullptr ? output : buffers[(size_t)worker].data(),
+                       scratch[(size_t)worker].data());
+                claimed = true;
+                ticket = tickets.next.load();
+            }
+        }
+        busyWorkers--;
+        return claimed;
+    }
+
+    struct alignas(64) Tickets //items of all jobs are numbered on, the current job is [jobBegin, end)
+    {
+        std::atomic<long long> next { 0 };
+        std::atomic<long long> end { 0 };
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::vector<float>> buffers;
+    std::vector<std::vector<float>> scratch;
+    int maxSamples = 0;
+    Tickets tickets;
+    alignas(64) std::atomic<int> busyWorkers { 0 };
+    long long jobBegin = 0;
+    void* currentBody = nullptr;
+    void (*invoke)(void*, int, float*, float*) = nullptr;
+    std::atomic<bool> enabled { false };
+    std::atomic<bool> fallback { false };
+    std::atomic<int> missedDeadlines { 0 };
+};
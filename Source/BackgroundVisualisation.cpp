@@ -13,123 +13,126 @@
 
 #include "BackgroundVisualisation.h"
 
-BackgroundVisualisation::BackgroundVisualisation(int numberOfIntervals, int octaves, int notesPerOctave,
-    float root, std::vector<float>& partialRatios, std::vector<float>& amplitudes)
-    : numberOfIntervals(numberOfIntervals),
-    octaves(octaves),
-    notesPerOctave(notesPerOctave),
-    root(root),
-    partialRatios(partialRatios),
-    amplitudes(amplitudes),
+BackgroundVisualisation::BackgroundVisualisation(int octaves, int notesPerOctave)
+    : octaves(octaves),
     currentDissonance(0.0f)
 {
     numberOfNotes = notesPerOctave * octaves;
-    numberOfPartials = partialRatios.size();
     dissvector.resize(numberOfNotes, 0.0f);
-    intervals.resize(numberOfIntervals, 0.0f);
-    allPartials.resize((size_t)((size_t)numberOfIntervals + 1) * numberOfPartials, 0.0f);
-    allAmplitudes.resize((size_t)((size_t)numberOfIntervals + 1) * numberOfPartials, 0.0f);
+    setOpaque(true);
 }
 
-void BackgroundVisualisation::update()
-{    
-    for (int i = 0; i < (numberOfIntervals + 1); i++)
-        std::copy(amplitudes.begin(), amplitudes.end(), allAmplitudes.begin() + (i * amplitudes.size())); //all amplitudes + new amplitudes
-
-    calculateFrequencies();
-
-    std::vector<float> newPartials(numberOfPartials, -1.0f);
-    std::copy(newPartials.begin(), newPartials.end(), allPartials.begin() + (numberOfIntervals * numberOfPartials));
-    currentDissonance = dissmeasure(allPartials, allAmplitudes);
+void BackgroundVisualisation::setDissonances(const std::vector<float>& newDissvector, int newOctaves, float newCurrentDissonance)
+{
+    const bool layoutChanged = (int)newDissvector.size() != numberOfNotes || newOctaves != octaves;
+    dissvector = newDissvector;
+    numberOfNotes = (int)dissvector.size();
+    octaves = newOctaves;
+    currentDissonance = newCurrentDissonance;
 
-    for (int i = 0; i < numberOfNotes; i++) 
+    if (layoutChanged || ! keyboard.isValid())
     {
-        for (int j = 0; j < numberOfPartials; j++) 
-        {
-            newPartials[j] = root * partialRatios[j] * std::pow(2.0f, (float)i / notesPerOctave);
-        }
-        std::copy(newPartials.begin(), newPartials.end(), allPartials.begin() + (numberOfIntervals * numberOfPartials));
-        dissvector[i] = dissmeasure(allPartials, allAmplitudes);
+        redrawAll();
+        repaint();
+        return;
     }
 
-    float dissvector_min = *min_element(dissvector.begin(), dissvector.begin() + numberOfNotes);
-    for (int i = 0; i < numberOfNotes; i++)
-        dissvector[i] = dissvector[i] - dissvector_min;
-
-    float dissvector_max = *max_element(dissvector.begin(), dissvector.begin() + numberOfNotes);
+    juce::Graphics g(keyboard);
+    g.addTransform(juce::AffineTransform::scale(scale));
     for (int i = 0; i < numberOfNotes; i++)
-        dissvector[i] = dissvector[i] / dissvector_max;
-
-    repaint();
+    {
+        if (std::abs(dissvector[i] - drawnDissonances[i]) < repaintThreshold && getLabelIndex(dissvector[i]) == getLabelIndex(drawnDissonances[i]))
+            continue;
+        redrawCell(g, i);
+        repaint(getCellBounds(i)); //the peer collects the cells into one region
+    }
 }
 
 void BackgroundVisualisation::paint(Graphics& g)
 {
-    // (Our component is opaque, so we must completely fill the background with a solid colour)
-    g.fillAll(juce::Colours::beige);
-    float rectwidth = getWidth() / (float)numberOfNotes;
-    float rectheight = (float)getHeight();
-    for (int i = 0; i < numberOfNotes; i++) 
+    const float paintScale = g.getInternalContext().getPhysicalPixelScaleFactor();
+    if (paintScale != scale)
     {
-        g.setColour(juce::Colour::fromFloatRGBA(0.0f, 0.0f, 0.0f, dissvector[i]));
-        juce::Rectangle<float> rectangle (0.0f + (i * rectwidth), 0.0f, rectwidth, rectheight);
-        g.fillRect(rectangle);
-        g.setColour(juce::Colours::red);
-        g.setFont(10.0f);
-        g.drawText(juce::String(std::roundf(100 * dissvector[i])), rectangle, juce::Justification::centredBottom, true);
+        scale = paintScale;
+        labels.clear();
+        redrawAll();
     }
-    g.setColour(juce::Colours::red);
-    for (int i = 1; i < octaves; i++)
-        g.fillRect(juce::Rectangle<float>(i * (float)getWidth() / octaves, 0.0f, 1.5f, (float)getHeight()));
+    if (keyboard.isValid())
+        g.drawImage(keyboard, getLocalBounds().toFloat());
+    else
+        g.fillAll(juce::Colours::beige);
 }
 
-float BackgroundVisualisation::dissmeasure(std::vector<float>& freq, std::vector<float>& amp)
+void BackgroundVisualisation::resized()
 {
-    const float x_star = 0.24f; 
-    const float s1 = 0.0207f; 
-    const float s2 = 18.96f;
-    const float b1 = 3.51f; 
-    const float b2 = 5.75f;
-
-    float d = 0.0f; 
-    
-    const int N = freq.size();
-    jassert(freq.size() == amp.size());
-
-    //convert amplitudes of sine waves to loudnesses => Sethares (p. 346)
-    std::vector<float> loudness(N);
-    for (int j = 0; j < N; j++) 
+    redrawAll();
+}
+
+void BackgroundVisualisation::redrawAll()
+{
+    drawnDissonances = dissvector;
+    const int width = juce::roundToInt(getWidth() * scale);
+    const int height = juce::roundToInt(getHeight() * scale);
+    if (width <= 0 || height <= 0)
     {
-        float SPL = 2 * std::log10((amp[j] / juce::MathConstants<float>::sqrt2) / 0.00002f);
-        loudness[j] = 0.0625f * std::pow(2.0f, SPL); 
+        keyboard = juce::Image();
+        return;
     }
 
-    //write exp-function in lookup-table? (std::vector -> length 64?) ... x-values = s * f_dif
-    for (int i = 0; i < N; i++) 
+    if (labels.empty())
     {
-        if (freq[i] >= 0) 
+        const juce::Font font(10.0f);
+        for (int i = 0; i <= 100; i++)
         {
-            for (int j = 0; j < N; j++) 
-            {
-                if (freq[j] >= 0) 
-                {
-                    float l_ij = std::min(loudness[i], loudness[j]);
-                    float s = x_star / (s1 * std::min(freq[i], freq[j]) + s2);
-                    float f_dif = std::abs(freq[i] - freq[j]);
-                    d += l_ij * (std::exp(-b1 * s * f_dif) - std::exp(-b2 * s * f_dif));
-                }
-            }
+            const juce::String text(std::roundf((float)i));
+            juce::Image label(juce::Image::ARGB, juce::roundToInt((font.getStringWidthFloat(text) + 2.0f) * scale), juce::roundToInt((font.getHeight() + 1.0f) * scale), true);
+            juce::Graphics lg(label);
+            lg.addTransform(juce::AffineTransform::scale(scale));
+            lg.setColour(juce::Colours::red);
+            lg.setFont(font);
+            lg.drawText(text, juce::Rectangle<float>(0.0f, 0.0f, label.getWidth() / scale, label.getHeight() / scale), juce::Justification::centredBottom, false);
+            labels.push_back(label);
         }
     }
-    return d;
+
+    if (! keyboard.isValid() || keyboard.getWidth() != width || keyboard.getHeight() != height)
+        keyboard = juce::Image(juce::Image::RGB, width, height, false);
+    juce::Graphics g(keyboard);
+    g.addTransform(juce::AffineTransform::scale(scale));
+    for (int i = 0; i < numberOfNotes; i++)
+        redrawCell(g, i);
 }
 
-void BackgroundVisualisation::calculateFrequencies()
+void BackgroundVisualisation::redrawCell(juce::Graphics& g, int cell)
 {
-    for (int j = 0; j < numberOfIntervals; j++) 
+    const auto bounds = getCellBounds(cell);
+    g.saveState();
+    g.reduceClipRegion(bounds);
+    g.setColour(juce::Colours::beige);
+    g.fillRect(bounds);
+    g.setColour(juce::Colour::fromFloatRGBA(0.0f, 0.0f, 0.0f, dissvector[cell]));
+    g.fillRect(bounds);
+
+    if (bounds.getWidth() >= minimumLabelWidth) //not in the one pixel wide cells of the continuous map
     {
-        for (int i = 0; i < numberOfPartials; i++)
-
-            allPartials[i + (j * numberOfPartials)] = root * partialRatios[i] * intervals[j];
+        const auto& label = labels[(size_t)getLabelIndex(dissvector[cell])];
+        const float labelWidth = label.getWidth() / scale;
+        const float labelHeight = label.getHeight() / scale;
+        g.drawImage(label, juce::Rectangle<float>(bounds.getCentreX() - labelWidth / 2, bounds.getBottom() - labelHeight, labelWidth, labelHeight));
     }
+
+    //the octave lines lie on top of the cells
+    g.setColour(juce::Colours::red);
+    for (int i = 1; i < octaves; i++)
+        g.fillRect(juce::Rectangle<float>(i * (float)getWidth() / octaves, 0.0f, 1.5f, (float)getHeight()));
+    g.restoreState();
+    drawnDissonances[(size_t)cell] = dissvector[(size_t)cell];
+}
+
+//whole pixels, so a cell can be redrawn without touching its neighbours
+juce::Rectangle<int> BackgroundVisualisation::getCellBounds(int cell) const
+{
+    const int left = juce::roundToInt(cell * (float)getWidth() / numberOfNotes);
+    const int right = juce::roundToInt((cell + 1) * (float)getWidth() / numberOfNotes);
+    return { left, 0, right - left, getHeight() };
 }
@@ -17,44 +17,31 @@
 class BackgroundVisualisation : public Component
 {
 public:
-    BackgroundVisualisation(int numberofintervals, int octaves, int notesPerOctave, float root,
-        std::vector<float>& partials_ratios, std::vector<float>& amplitudes);
-
-    void setPartialRatios(std::vector<float>& newPartialRatios) 
-    { 
-        partialRatios = newPartialRatios; 
-        numberOfPartials = partialRatios.size();
-        allPartials = std::vector<float>(((size_t)numberOfIntervals + 1) * (size_t)numberOfPartials, 0.0f);
-    }
-
-    void setAmplitudes(std::vector<float>& newAmplitudes) 
-    { 
-        amplitudes = newAmplitudes;
-        allAmplitudes = std::vector<float>(((size_t)numberOfIntervals + 1) * (size_t)numberOfPartials, 0.0f);
-    }
-
-    void setRoot(float newRoot) { root = newRoot; }
-    void setOctaves(int newOctaves) { octaves = newOctaves; numberOfNotes = notesPerOctave * octaves; }
-    void setNotesPerOctave(int newNotesPerOctave) { notesPerOctave = newNotesPerOctave; numberOfNotes = notesPerOctave * octaves; }
-    void setIntervals(std::vector<float>& intvls) { jassert(intervals.size() == numberOfIntervals); intervals = intvls; };
+    BackgroundVisualisation(int octaves, int notesPerOctave);
+
+    //the map is computed by the DissonanceAnalyser => this only shows its latest frame
+    void setDissonances(const std::vector<float>& newDissvector, int newOctaves, float newCurrentDissonance);
     float getCurrentDissonance() { return currentDissonance; };
-    void update();
 
 private:
     void paint(Graphics& g) override;
-    float dissmeasure(std::vector<float>& freq, std::vector<float>& amp);
-    void calculateFrequencies();
-    float root;
+    void resized() override;
+
+    //the keyboard is kept in an image, a new frame only redraws (and repaints) the cells that visibly changed
+    void redrawAll();
+    void redrawCell(juce::Graphics& g, int cell);
+    juce::Rectangle<int> getCellBounds(int cell) const;
+    static int getLabelIndex(float dissonance) { return juce::jlimit(0, 100, (int)std::roundf(100 * dissonance)); }
+
+    static constexpr float repaintThreshold = 0.5f / 255.0f; //half a grey level
+    static const int minimumLabelWidth = 4;
+
     int octaves;
-    int notesPerOctave;
-    int numberOfPartials;
     int numberOfNotes;
-    int numberOfIntervals;
     float currentDissonance;
-    std::vector<float> amplitudes;
-    std::vector<float> partialRatios;
     std::vector<float> dissvector;
-    std::vector<float> intervals;
-    std::vector<float> allPartials;
-    std::vector<float> allAmplitudes;
+    std::vector<float> drawnDissonances; //as they are in the image
+    juce::Image keyboard;
+    std::vector<juce::Image> labels; //"0" ... "100", rendered once per scale
+    float scale = 1.0f; //physical pixels per logical pixel of the last paint
 };
@@ -0,0 +1,190 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include "AllocationCounter.h"
+#include "TripleBuffer.h"
+#include "DissonanceMapEngine.h"
+#include "DissonanceFieldEngine.h"
+#include "DissonanceCurveEngine.h"
+
+//everything the analysis needs, copied from the message thread
+struct AnalysisRequest
+{
+    float root = 0.0f;
+    int notesPerOctave = 12;
+    int octaves = 1;
+    std::vector<float> partialRatios;
+    std::vector<float> amplitudes;
+    std::vector<float> intervals;
+    bool continuous = false; //unquantised pitch => the map has one value per pixel
+    int width = 0;
+};
+
+struct AnalysisResult
+{
+    std::vector<float> map;
+    int octaves = 1;
+    float currentDissonance = 0.0f;
+    int mapFrame = 0;
+    std::vector<float> curve;
+    std::vector<CurveMinimum> minima;
+    int curveFrame = 0;
+};
+
+/*  Runs DissonanceMapEngine and DissonanceCurveEngine on a background thread,
+    their loops are split across a WorkerPool with one thread per remaining core.
+
+    The message thread posts the newest snapshot with request(), older snapshots
+    which haven't been picked up yet are dropped. Results are published through a
+    TripleBuffer, so getLatestResult() always returns a complete frame, and the
+    listener is triggered on the message thread whenever a new one is ready.
+    The curve, and the map in continuous mode, are refined in slices of
+    refineSliceMilliseconds, each slice is published, and a new request
+    interrupts the refinement.
+    The engines are prepared for the largest configuration, so the analysis
+    doesn't touch the heap, which is checked in debug builds.
+*/
+class DissonanceAnalyser : private juce::Thread
+{
+public:
+    enum Work
+    {
+        updateMap = 1,
+        updateCurve = 2
+    };
+
+    static const int maxWidth = 4096; //pixels of the continuous map
+
+    DissonanceAnalyser(int numberOfIntervals, int maxNumberOfPartials, int maxNumberOfNotes, juce::AsyncUpdater& listener)
+        : juce::Thread("Dissonance Analysis"),
+          mapEngine(numberOfIntervals),
+          fieldEngine(numberOfIntervals),
+          listener(listener)
+    {
+        mapEngine.setWorkerPool(&pool);
+        mapEngine.prepare(maxNumberOfPartials, maxNumberOfNotes);
+        fieldEngine.setWorkerPool(&pool);
+        fieldEngine.prepare(maxNumberOfPartials, maxWidth);
+        curveEngine.setWorkerPool(&pool);
+        curveEngine.prepare(maxNumberOfPartials, pool.getNumberOfWorkers());
+        startThread();
+    }
+
+    ~DissonanceAnalyser() override
+    {
+        signalThreadShouldExit();
+        notify();
+        stopThread(2000);
+    }
+
+    //message thread only
+    void request(const AnalysisRequest& snapshot, int work)
+    {
+        requests.getWriteBuffer() = snapshot;
+        requests.publish();
+        pendingWork.fetch_or(work);
+        notify();
+    }
+
+    //message thread only => nullptr if there is no new result since the last call
+    const AnalysisResult* getLatestResult()
+    {
+        return results.acquire() ? &results.getReadBuffer() : nullptr;
+    }
+
+private:
+    void run() override
+    {
+        AllocationCounter::watchCurrentThread(true);
+        while (! threadShouldExit())
+        {
+            if (! isRefining())
+                wait(-1);
+
+            int work = pendingWork.exchange(0);
+            if (threadShouldExit() || (work == 0 && ! isRefining()))
+                continue;
+
+            requests.acquire(); //keeps the last snapshot if it was already picked up
+
+            const AnalysisRequest& snapshot = requests.getReadBuffer();
+            AllocationCounter::Scope allocations;
+            if ((work & updateMap) && snapshot.continuous)
+            {
+                fieldEngine.setSpectrum(snapshot.partialRatios, snapshot.amplitudes);
+                fieldEngine.setRange(snapshot.root, snapshot.octaves, juce::jlimit(0, maxWidth, snapshot.width));
+                fieldEngine.setIntervals(snapshot.intervals);
+                fieldEngine.restartIfChanged();
+                continuous = true;
+            }
+            else if (work & updateMap)
+            {
+                mapEngine.setSpectrum(snapshot.partialRatios, snapshot.amplitudes);
+                mapEngine.setGrid(snapshot.root, snapshot.notesPerOctave, snapshot.octaves);
+                mapEngine.setIntervals(snapshot.intervals);
+                if (mapEngine.update() || continuous)
+                    mapFrame++;
+                fieldEngine.invalidate();
+                continuous = false;
+            }
+            if (continuous && fieldEngine.isRefining())
+            {
+                fieldEngine.refine(refineSliceMilliseconds);
+                mapFrame++;
+            }
+            if (work & updateCurve)
+            {
+                curveEngine.setSpectrum(snapshot.partialRatios, snapshot.amplitudes);
+                curveEngine.setRoot(snapshot.root);
+                curveEngine.restart();
+            }
+            if (curveEngine.isRefining())
+            {
+                curveEngine.refine(refineSliceMilliseconds);
+                curveFrame++;
+            }
+            jassert(allocations.getAllocations() == 0); //something wasn't prepared for this configuration
+
+            AnalysisResult& result = results.getWriteBuffer();
+            result.map = continuous ? fieldEngine.getDissonances() : mapEngine.getDissonances();
+            result.octaves = continuous ? fieldEngine.getOctaves() : mapEngine.getOctaves();
+            result.currentDissonance = continuous ? fieldEngine.getCurrentDissonance() : mapEngine.getCurrentDissonance();
+            result.mapFrame = mapFrame;
+            result.curve = curveEngine.getDissonances();
+            result.minima = curveEngine.getMinima();
+            result.curveFrame = curveFrame;
+            results.publish();
+            listener.triggerAsyncUpdate();
+        }
+    }
+
+    static constexpr double refineSliceMilliseconds = 4.0;
+
+    bool isRefining() const { return fieldEngine.isRefining() || curveEngine.isRefining(); }
+
+    WorkerPool pool;
+    DissonanceMapEngine mapEngine;
+    DissonanceFieldEngine fieldEngine;
+    bool continuous = false;
+    DissonanceCurveEngine curveEngine;
+    TripleBuffer<AnalysisRequest> requests;
+    TripleBuffer<AnalysisResult> results;
+    std::atomic<int> pendingWork { 0 };
+    int mapFrame = 0;
+    int curveFrame = 0;
+    juce::AsyncUpdater& listener;
+
+    JUCE_DECLARE_NON_COPYABLE(DissonanceAnalyser)
+};
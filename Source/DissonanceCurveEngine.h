@@ -0,0 +1,229 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include <vector>
+#include "AdaptiveSampler.h"
+#include "Roughness.h"
+#include "WorkerPool.h"
+
+//a dip of the dissonance curve, candidates for the steps of a scale
+struct CurveMinimum
+{
+    float cents;
+    float ratio;
+    float depth; //how far the curve rises (0...1) before it comes down to a deeper point, on the lower side
+};
+
+/*  Computes the dissonance curve shown by DissonanceCurve: the dissonance of the
+    spectrum with a copy of itself transposed over one octave (0 ... 1200 cents,
+    one data point per cent), normalised to 0...1.
+    Has no GUI dependencies, so it can run on the analysis thread.
+
+    Per data point: self(root) + self(shifted) + 2 * cross(root, shifted), with the
+    partials sorted by ratio so Roughness can prune pairs outside the critical band.
+    restart() forgets the old curve, refine() computes every coarseStep-th cent
+    first and then refines around the dips and steep flanks (AdaptiveSampler) for
+    a given time, until all cents are known. Then the minima are placed between
+    the cents by a parabola through their neighbours.
+*/
+class DissonanceCurveEngine
+{
+public:
+    static const int centsPerOctave = 1200;
+    static const int numberOfDataPoints = centsPerOctave + 1;
+    static const int coarseStep = 12;
+    static constexpr float minimumDepth = 0.01f; //shallower dips are not reported
+
+    DissonanceCurveEngine()
+    {
+        dissvector.resize((size_t)numberOfDataPoints, 0.0f);
+    }
+
+    //reserves everything, so setSpectrum(), restart() and refine() don't allocate up to this size
+    void prepare(int maxNumberOfPartials, int maxNumberOfWorkers)
+    {
+        givenRatios.reserve((size_t)maxNumberOfPartials);
+        givenAmplitudes.reserve((size_t)maxNumberOfPartials);
+        order.reserve((size_t)maxNumberOfPartials);
+        partialRatios.reserve((size_t)maxNumberOfPartials);
+        loudness.reserve((size_t)maxNumberOfPartials);
+        rootPartials.reserve((size_t)maxNumberOfPartials);
+        shiftedPartials.reserve((size_t)maxNumberOfWorkers * maxNumberOfPartials);
+        minima.reserve((size_t)numberOfDataPoints / 2 + 1);
+        sampler.prepare(numberOfDataPoints);
+    }
+
+    void setSpectrum(const std::vector<float>& newPartialRatios, const std::vector<float>& newAmplitudes)
+    {
+        assert(newPartialRatios.size() == newAmplitudes.size());
+        if (newPartialRatios == givenRatios && newAmplitudes == givenAmplitudes)
+            return;
+
+        givenRatios = newPartialRatios;
+        givenAmplitudes = newAmplitudes;
+        numberOfPartials = (int)newPartialRatios.size();
+
+        order.resize((size_t)numberOfPartials);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return newPartialRatios[a] < newPartialRatios[b]; });
+        partialRatios.resize((size_t)numberOfPartials);
+        loudness.resize((size_t)numberOfPartials);
+        for (int j = 0; j < numberOfPartials; j++)
+        {
+            partialRatios[j] = newPartialRatios[order[j]];
+            loudness[j] = Roughness::loudness(newAmplitudes[order[j]]);
+        }
+    }
+
+    void setRoot(float newRoot) { root = newRoot; }
+
+    //data points are split across the pool, nullptr => everything on the calling thread
+    void setWorkerPool(WorkerPool* newPool) { pool = newPool; }
+
+    //starts a new curve for the current spectrum and root
+    void restart()
+    {
+        rootPartials.resize((size_t)numberOfPartials);
+        calculate_frequencies(rootPartials.data());
+        rootDissonance = Roughness::dissmeasure(rootPartials.data(), loudness.data(), numberOfPartials);
+
+        //every worker gets its own buffer for the shifted partials
+        const int numberOfWorkers = pool != nullptr ? pool->getNumberOfWorkers() : 1;
+        shiftedPartials.resize((size_t)numberOfWorkers * numberOfPartials);
+        sampler.restart(numberOfDataPoints, coarseStep);
+        minima.clear();
+    }
+
+    bool isRefining() const { return sampler.isRefining(); }
+
+    //computes data points for about the given time (the coarse ones all at once), then updates curve and minima
+    void refine(double milliseconds)
+    {
+        const int numberOfWorkers = pool != nullptr ? pool->getNumberOfWorkers() : 1;
+        sampler.refine(milliseconds, 4 * numberOfWorkers, [this](const int* points, float* values, int numberOfPoints)
+        {
+            auto body = [&](int begin, int end, int worker)
+            {
+                for (int p = begin; p < end; p++)
+                    values[p] = evaluate((float)points[p], worker);
+            };
+            if (pool != nullptr)
+                pool->parallelFor(numberOfPoints, 4, body);
+            else
+                body(0, numberOfPoints, 0);
+        });
+
+        sampler.interpolate(dissvector.data());
+        float dissvector_max = *std::max_element(dissvector.begin(), dissvector.end());
+        if (dissvector_max > 0.0f) //a silent spectrum => all zero, nothing to normalise and no minima
+            for (size_t i = 0; i < dissvector.size(); i++)
+                dissvector[i] = dissvector[i] / dissvector_max;
+        findMinima(dissvector_max);
+    }
+
+    //all data points at once, like before the refinement
+    void update()
+    {
+        restart();
+        while (isRefining())
+            refine(1.0e9);
+    }
+
+    const std::vector<float>& getDissonances() const { return dissvector; }
+
+    //from low to high, between the cents once the curve is complete
+    const std::vector<CurveMinimum>& getMinima() const { return minima; }
+
+private:
+    float evaluate(float cents, int worker)
+    {
+        float* partials = shiftedPartials.data() + (size_t)worker * numberOfPartials;
+        const float shift = std::pow(2.0f, cents / centsPerOctave);
+        for (int j = 0; j < numberOfPartials; j++)
+            partials[j] = root * partialRatios[j] * shift;
+
+        return rootDissonance + Roughness::dissmeasure(partials, loudness.data(), numberOfPartials)
+             + 2.0f * Roughness::crossDissmeasure(rootPartials.data(), loudness.data(), numberOfPartials,
+                                                  partials, loudness.data(), numberOfPartials);
+    }
+
+    //local minima of the known data points with their prominence, maximum => normalisation of the depth
+    void findMinima(float maximum)
+    {
+        minima.clear();
+        if (sampler.getNumberOfKnownSamples() == 0 || maximum <= 0.0f)
+            return;
+        const bool complete = ! sampler.isRefining();
+        for (int x = 0; x >= 0; x = sampler.getNext(x))
+        {
+            if (! sampler.isLocalMinimum(x))
+                continue;
+            const float value = sampler.getSample(x);
+
+            //highest point on each side before the curve gets deeper than this dip (or ends)
+            float leftMax = -1.0f;
+            for (int l = sampler.getPrevious(x); l >= 0 && sampler.getSample(l) >= value; l = sampler.getPrevious(l))
+                leftMax = std::max(leftMax, sampler.getSample(l));
+            float rightMax = -1.0f;
+            for (int r = sampler.getNext(x); r >= 0 && sampler.getSample(r) >= value; r = sampler.getNext(r))
+                rightMax = std::max(rightMax, sampler.getSample(r));
+            const float rise = leftMax < 0.0f ? rightMax : (rightMax < 0.0f ? leftMax : std::min(leftMax, rightMax));
+            const float depth = (rise - value) / maximum;
+            if (depth < minimumDepth)
+                continue;
+
+            float cents = (float)x;
+            const int l = sampler.getPrevious(x);
+            const int r = sampler.getNext(x);
+            if (complete && l == x - 1 && r == x + 1) //between the cents: vertex of the parabola through the neighbours
+            {
+                const float a = sampler.getSample(l);
+                const float c = sampler.getSample(r);
+                const float curvature = a - 2.0f * value + c;
+                if (curvature > 0.0f)
+                {
+                    const float vertex = x + 0.5f * (a - c) / curvature;
+                    if (evaluate(vertex, 0) < value)
+                        cents = vertex;
+                }
+            }
+            minima.push_back({ cents, std::pow(2.0f, cents / centsPerOctave), depth });
+        }
+    }
+
+    void calculate_frequencies(float* partials)
+    {
+        for (int i = 0; i < numberOfPartials; i++)
+            partials[i] = root * partialRatios[i];
+    }
+
+    float root = 0.0f;
+    float rootDissonance = 0.0f;
+    int numberOfPartials = 0;
+    std::vector<float> givenRatios;
+    std::vector<float> givenAmplitudes;
+    std::vector<int> order;
+    std::vector<float> partialRatios;
+    std::vector<float> dissvector;
+    std::vector<float> loudness;
+    std::vector<float> rootPartials;
+    std::vector<float> shiftedPartials;
+    std::vector<CurveMinimum> minima;
+    AdaptiveSampler sampler;
+    WorkerPool* pool = nullptr;
+};
@@ -0,0 +1,234 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numeric>
+#include <vector>
+#include "AdaptiveSampler.h"
+#include "Roughness.h"
+#include "WorkerPool.h"
+
+/*  The keyboard map for unquantised pitch: the dissonance of the held chord plus
+    a note at every pixel (root * 2^(octaves * x / width)), normalised to 0...1.
+
+    Computing every pixel after every finger move is too slow, so the field is
+    sampled every coarseStep pixels first and then refined around the valleys
+    and steep flanks by an AdaptiveSampler until every pixel is known.
+    refine() works for a given time and is called again until isRefining() is
+    false, in between the field is interpolated from what is known.
+    Has no GUI dependencies, so it can run on the analysis thread.
+*/
+class DissonanceFieldEngine
+{
+public:
+    static const int coarseStep = 32;
+
+    DissonanceFieldEngine(int newNumberOfIntervals)
+        : numberOfIntervals(newNumberOfIntervals)
+    {
+        intervals.resize((size_t)numberOfIntervals, 0.0f);
+    }
+
+    //midpoints are evaluated across the pool, nullptr => everything on the calling thread
+    void setWorkerPool(WorkerPool* newPool) { pool = newPool; }
+
+    //reserves everything, so refine() doesn't allocate up to this size
+    void prepare(int maxNumberOfPartials, int maxWidth)
+    {
+        const int numberOfWorkers = pool != nullptr ? pool->getNumberOfWorkers() : 1;
+        givenRatios.reserve((size_t)maxNumberOfPartials);
+        givenAmplitudes.reserve((size_t)maxNumberOfPartials);
+        order.reserve((size_t)maxNumberOfPartials);
+        sortedRatios.reserve((size_t)maxNumberOfPartials);
+        loudness.reserve((size_t)maxNumberOfPartials);
+        heldFrequencies.reserve((size_t)numberOfIntervals * maxNumberOfPartials);
+        heldFingers.reserve((size_t)numberOfIntervals);
+        scratch.reserve((size_t)numberOfWorkers * maxNumberOfPartials);
+        field.reserve((size_t)maxWidth);
+        sampler.prepare(maxWidth);
+    }
+
+    void setSpectrum(const std::vector<float>& newPartialRatios, const std::vector<float>& newAmplitudes)
+    {
+        assert(newPartialRatios.size() == newAmplitudes.size());
+        if (newPartialRatios == givenRatios && newAmplitudes == givenAmplitudes)
+            return;
+
+        givenRatios = newPartialRatios;
+        givenAmplitudes = newAmplitudes;
+        numberOfPartials = (int)newPartialRatios.size();
+        order.resize((size_t)numberOfPartials);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return newPartialRatios[a] < newPartialRatios[b]; });
+        sortedRatios.resize((size_t)numberOfPartials);
+        loudness.resize((size_t)numberOfPartials);
+        for (int j = 0; j < numberOfPartials; j++)
+        {
+            sortedRatios[j] = newPartialRatios[order[j]];
+            loudness[j] = Roughness::loudness(newAmplitudes[order[j]]);
+        }
+        changed = true;
+    }
+
+    void setRange(float newRoot, int newOctaves, int newWidth)
+    {
+        if (newRoot == root && newOctaves == octaves && newWidth == width)
+            return;
+        root = newRoot;
+        octaves = newOctaves;
+        width = std::max(0, newWidth);
+        changed = true;
+    }
+
+    void setIntervals(const std::vector<float>& intvls)
+    {
+        assert((int)intvls.size() == numberOfIntervals);
+        if (intvls == intervals)
+            return;
+        intervals = intvls;
+        changed = true;
+    }
+
+    //the next restartIfChanged() starts over even if nothing changed
+    void invalidate()
+    {
+        changed = true;
+        sampler.stop();
+    }
+
+    //starts over from the coarse samples if anything changed since the last call, returns false if nothing did
+    bool restartIfChanged()
+    {
+        if (! changed && Roughness::getSettingsId() == settingsId)
+            return false;
+        changed = false;
+        settingsId = Roughness::getSettingsId();
+
+        heldFingers.clear();
+        heldFrequencies.resize((size_t)numberOfIntervals * numberOfPartials);
+        for (int k = 0; k < numberOfIntervals; k++)
+        {
+            if (intervals[k] <= 0.0f)
+                continue;
+            heldFingers.push_back(k);
+            calculateFrequencies(intervals[k], &heldFrequencies[(size_t)k * numberOfPartials]);
+        }
+
+        //dissonance of the held chord = sum over all ordered pairs of held notes
+        currentDissonance = 0.0f;
+        for (int u : heldFingers)
+            for (int v : heldFingers)
+                currentDissonance += cross(getHeldFrequencies(u), getHeldFrequencies(v));
+
+        const int numberOfWorkers = pool != nullptr ? pool->getNumberOfWorkers() : 1;
+        scratch.resize((size_t)numberOfWorkers * numberOfPartials);
+        field.assign((size_t)width, 0.0f);
+        sampler.restart(width, coarseStep);
+        return true;
+    }
+
+    bool isRefining() const { return sampler.isRefining(); }
+
+    //computes samples for about the given time (the coarse ones all at once), then updates the field
+    void refine(double milliseconds)
+    {
+        const int numberOfWorkers = pool != nullptr ? pool->getNumberOfWorkers() : 1;
+        sampler.refine(milliseconds, 4 * numberOfWorkers, [this](const int* points, float* values, int numberOfPoints)
+        {
+            auto body = [&](int begin, int end, int worker)
+            {
+                float* frequencies = scratch.data() + (size_t)worker * numberOfPartials;
+                for (int p = begin; p < end; p++)
+                    values[p] = evaluate((float)points[p], frequencies);
+            };
+            if (pool != nullptr)
+                pool->parallelFor(numberOfPoints, 1, body);
+            else
+                body(0, numberOfPoints, 0);
+        });
+        updateField();
+    }
+
+    const std::vector<float>& getDissonances() const { return field; }
+    float getCurrentDissonance() const { return currentDissonance; }
+    int getOctaves() const { return octaves; }
+    int getNumberOfKnownSamples() const { return sampler.getNumberOfKnownSamples(); }
+
+    //pitch of pixel x relative to the root
+    float getInterval(float x) const { return width > 0 ? std::pow(2.0f, octaves * x / width) : 1.0f; }
+
+private:
+    //held chord + a note at pixel x, like DissonanceMapEngine: own dissonance + twice the cross terms
+    float evaluate(float x, float* frequencies) const
+    {
+        calculateFrequencies(getInterval(x), frequencies);
+        float dissonance = currentDissonance + cross(frequencies, frequencies);
+        for (int k : heldFingers)
+            dissonance += 2.0f * cross(getHeldFrequencies(k), frequencies);
+        return dissonance;
+    }
+
+    //known samples are joined by straight lines, then normalised like the grid map
+    void updateField()
+    {
+        if (width <= 0)
+            return;
+        sampler.interpolate(field.data());
+
+        const float fieldMin = *std::min_element(field.begin(), field.end());
+        for (float& value : field)
+            value -= fieldMin;
+        const float fieldMax = *std::max_element(field.begin(), field.end());
+        if (fieldMax > 0.0f)
+            for (float& value : field)
+                value /= fieldMax;
+    }
+
+    const float* getHeldFrequencies(int k) const { return &heldFrequencies[(size_t)k * numberOfPartials]; }
+
+    void calculateFrequencies(float interval, float* freq) const
+    {
+        for (int i = 0; i < numberOfPartials; i++)
+            freq[i] = root * sortedRatios[i] * interval;
+    }
+
+    float cross(const float* freqA, const float* freqB) const
+    {
+        return Roughness::crossDissmeasure(freqA, loudness.data(), numberOfPartials,
+                                           freqB, loudness.data(), numberOfPartials);
+    }
+
+    int numberOfIntervals;
+    float root = 0.0f;
+    int octaves = 1;
+    int width = 0;
+    int numberOfPartials = 0;
+    float currentDissonance = 0.0f;
+    std::vector<float> givenRatios;
+    std::vector<float> givenAmplitudes;
+    std::vector<int> order;
+    std::vector<float> sortedRatios;
+    std::vector<float> loudness;
+    std::vector<float> intervals;
+    std::vector<float> heldFrequencies;
+    std::vector<int> heldFingers;
+    std::vector<float> scratch;
+    std::vector<float> field;
+    AdaptiveSampler sampler;
+    bool changed = true;
+    int settingsId = -1;
+    WorkerPool* pool = nullptr;
+};
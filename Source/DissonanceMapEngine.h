@@ -0,0 +1,199 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <vector>
+#include "DissonanceMatrix.h"
+
+/*  Computes the keyboard map shown by BackgroundVisualisation: the dissonance of
+    the held chord plus each note of the grid, normalised to 0...1.
+    Has no GUI dependencies, so it can run on the analysis thread.
+*/
+class DissonanceMapEngine
+{
+public:
+    DissonanceMapEngine(int newNumberOfIntervals)
+        : numberOfIntervals(newNumberOfIntervals)
+    {
+        intervals.resize(numberOfIntervals, 0.0f);
+        heldRows.resize(numberOfIntervals, nullptr);
+        heldNotes.resize(numberOfIntervals, -1);
+        intervalChanged.resize(numberOfIntervals, true);
+    }
+
+    void setWorkerPool(WorkerPool* pool) { matrix.setWorkerPool(pool); }
+
+    //reserves everything, so update() doesn't allocate up to this size
+    void prepare(int maxNumberOfPartials, int maxNumberOfNotes)
+    {
+        partialRatios.reserve((size_t)maxNumberOfPartials);
+        amplitudes.reserve((size_t)maxNumberOfPartials);
+        loudness.reserve((size_t)maxNumberOfPartials);
+        dissvector.reserve((size_t)maxNumberOfNotes);
+        chordCross.reserve((size_t)maxNumberOfNotes);
+        offGridRows.reserve((size_t)numberOfIntervals * maxNumberOfNotes);
+        matrix.prepare(maxNumberOfPartials, maxNumberOfNotes);
+    }
+
+    void setSpectrum(const std::vector<float>& newPartialRatios, const std::vector<float>& newAmplitudes)
+    {
+        assert(newPartialRatios.size() == newAmplitudes.size());
+        if (newPartialRatios == partialRatios && newAmplitudes == amplitudes)
+            return;
+
+        partialRatios = newPartialRatios;
+        amplitudes = newAmplitudes;
+        loudness.resize(amplitudes.size());
+        for (size_t j = 0; j < amplitudes.size(); j++)
+            loudness[j] = Roughness::loudness(amplitudes[j]);
+    }
+
+    void setGrid(float newRoot, int newNotesPerOctave, int newOctaves)
+    {
+        root = newRoot;
+        notesPerOctave = newNotesPerOctave;
+        octaves = newOctaves;
+        numberOfNotes = notesPerOctave * octaves;
+    }
+
+    void setIntervals(const std::vector<float>& intvls)
+    {
+        assert((int)intvls.size() == numberOfIntervals);
+        for (int k = 0; k < numberOfIntervals; k++)
+        {
+            if (intvls[k] != intervals[k])
+            {
+                intervals[k] = intvls[k];
+                intervalChanged[k] = true;
+            }
+        }
+    }
+
+    //returns false if nothing changed since the last update
+    //the loudness is only recomputed when the spectrum changes
+    bool update()
+    {
+        bool rebuild = matrix.configure(root, notesPerOctave, numberOfNotes, partialRatios, loudness) || ! chordValid;
+        bool anyIntervalChanged = std::find(intervalChanged.begin(), intervalChanged.end(), true) != intervalChanged.end();
+        if (! rebuild && ! anyIntervalChanged)
+            return false; //nothing to do => keep the last map
+
+        if (rebuild)
+        {
+            dissvector.resize(numberOfNotes);
+            offGridRows.resize((size_t)numberOfIntervals * numberOfNotes);
+            chordCross.assign(numberOfNotes, 0.0f);
+            std::fill(heldRows.begin(), heldRows.end(), nullptr);
+            std::fill(intervalChanged.begin(), intervalChanged.end(), true);
+        }
+
+        //only the fingers which moved are patched into the cross terms of the held chord
+        for (int k = 0; k < numberOfIntervals; k++)
+        {
+            if (! intervalChanged[k])
+                continue;
+            intervalChanged[k] = false;
+
+            if (heldRows[k] != nullptr)
+                for (int i = 0; i < numberOfNotes; i++)
+                    chordCross[i] -= heldRows[k][i];
+
+            heldRows[k] = nullptr;
+            heldNotes[k] = -1;
+            if (intervals[k] <= 0.0f)
+                continue;
+
+            heldNotes[k] = matrix.getNoteIndex(intervals[k]);
+            if (heldNotes[k] >= 0)
+            {
+                heldRows[k] = matrix.getRow(heldNotes[k]);
+            }
+            else //off the grid => uncached row
+            {
+                float* row = &offGridRows[(size_t)k * numberOfNotes];
+                matrix.computeRow(intervals[k], row);
+                heldRows[k] = row;
+            }
+
+            for (int i = 0; i < numberOfNotes; i++)
+                chordCross[i] += heldRows[k][i];
+        }
+
+        if (std::find_if(heldRows.begin(), heldRows.end(), [](const float* row) { return row != nullptr; }) == heldRows.end())
+            std::fill(chordCross.begin(), chordCross.end(), 0.0f); //no finger down => no accumulated rounding errors
+        chordValid = true;
+
+        //dissonance of the held chord = sum over all ordered pairs of held notes (once per tick)
+        currentDissonance = 0.0f;
+        for (int u = 0; u < numberOfIntervals; u++)
+        {
+            if (heldRows[u] == nullptr)
+                continue;
+            for (int v = 0; v < numberOfIntervals; v++)
+            {
+                if (heldRows[v] == nullptr)
+                    continue;
+                if (heldNotes[v] >= 0)
+                    currentDissonance += heldRows[u][heldNotes[v]];
+                else if (heldNotes[u] >= 0)
+                    currentDissonance += heldRows[v][heldNotes[u]];
+                else
+                    currentDissonance += matrix.computeCross(intervals[u], intervals[v]);
+            }
+        }
+
+        //held chord + candidate i => only the cross terms and the candidate's own dissonance are added
+        for (int i = 0; i < numberOfNotes; i++)
+            dissvector[i] = currentDissonance + 2.0f * chordCross[i] + matrix.getSelf(i);
+
+        if (numberOfNotes > 0)
+        {
+            float dissvector_min = *std::min_element(dissvector.begin(), dissvector.end());
+            for (int i = 0; i < numberOfNotes; i++)
+                dissvector[i] = dissvector[i] - dissvector_min;
+
+            float dissvector_max = *std::max_element(dissvector.begin(), dissvector.end());
+            if (dissvector_max > 0.0f) //flat map (one partial, silence) => stays 0 instead of NaN
+                for (int i = 0; i < numberOfNotes; i++)
+                    dissvector[i] = dissvector[i] / dissvector_max;
+        }
+        return true;
+    }
+
+    const std::vector<float>& getDissonances() const { return dissvector; }
+    float getCurrentDissonance() const { return currentDissonance; }
+    int getNumberOfNotes() const { return numberOfNotes; }
+    int getOctaves() const { return octaves; }
+
+private:
+    float root = 0.0f;
+    int octaves = 1;
+    int notesPerOctave = 12;
+    int numberOfNotes = 12;
+    int numberOfIntervals;
+    float currentDissonance = 0.0f;
+    std::vector<float> amplitudes;
+    std::vector<float> partialRatios;
+    std::vector<float> loudness;
+    std::vector<float> dissvector;
+    std::vector<float> intervals;
+    std::vector<float> offGridRows;
+    std::vector<float> chordCross;
+    std::vector<const float*> heldRows;
+    std::vector<int> heldNotes;
+    std::vector<bool> intervalChanged;
+    bool chordValid = false;
+    DissonanceMatrix matrix;
+};
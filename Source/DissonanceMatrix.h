@@ -0,0 +1,200 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+#include "Roughness.h"
+#include "WorkerPool.h"
+
+/*  Pairwise dissonance of all notes on the grid (root * 2^(n / notesPerOctave)).
+
+    Sethares' measure is additive over partial pairs, so the dissonance of a chord
+    is the sum of get(a, b) over all ordered pairs of its notes (a == b included,
+    which is the note's own dissonance). The table only depends on root, spectrum,
+    grid and the Roughness settings, so it is kept until configure() sees one of
+    those change. The partials are stored sorted by ratio, so every note is already
+    in the order the critical band pruning of Roughness needs.
+    Rows are filled the first time they are asked for, because only the rows of
+    held notes and the diagonal are ever needed.
+*/
+class DissonanceMatrix
+{
+public:
+    DissonanceMatrix() {}
+
+    //rows and the diagonal are split across the pool, nullptr => everything on the calling thread
+    void setWorkerPool(WorkerPool* newPool) { pool = newPool; }
+
+    //reserves everything, so configure() doesn't allocate up to this size
+    void prepare(int maxNumberOfPartials, int maxNumberOfNotes)
+    {
+        partialRatios.reserve((size_t)maxNumberOfPartials);
+        loudness.reserve((size_t)maxNumberOfPartials);
+        sortedRatios.reserve((size_t)maxNumberOfPartials);
+        sortedLoudness.reserve((size_t)maxNumberOfPartials);
+        order.reserve((size_t)maxNumberOfPartials);
+        scratch.reserve((size_t)maxNumberOfPartials);
+        scratchB.reserve((size_t)maxNumberOfPartials);
+        noteFrequencies.reserve((size_t)maxNumberOfNotes * maxNumberOfPartials);
+        table.reserve((size_t)maxNumberOfNotes * maxNumberOfNotes);
+        rowValid.reserve((size_t)maxNumberOfNotes);
+        diagonal.reserve((size_t)maxNumberOfNotes);
+    }
+
+    //returns true if the table had to be reset
+    bool configure(float newRoot, int newNotesPerOctave, int newNumberOfNotes,
+                   const std::vector<float>& newPartialRatios, const std::vector<float>& newLoudness)
+    {
+        if (newRoot == root && newNotesPerOctave == notesPerOctave && newNumberOfNotes == numberOfNotes
+            && newPartialRatios == partialRatios && newLoudness == loudness && Roughness::getSettingsId() == settingsId)
+            return false;
+
+        settingsId = Roughness::getSettingsId();
+        root = newRoot;
+        notesPerOctave = newNotesPerOctave;
+        numberOfNotes = newNumberOfNotes;
+        partialRatios = newPartialRatios;
+        loudness = newLoudness;
+        numberOfPartials = (int)partialRatios.size();
+
+        order.resize((size_t)numberOfPartials);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [this](int a, int b) { return partialRatios[a] < partialRatios[b]; });
+        sortedRatios.resize((size_t)numberOfPartials);
+        sortedLoudness.resize((size_t)numberOfPartials);
+        for (int i = 0; i < numberOfPartials; i++)
+        {
+            sortedRatios[i] = partialRatios[order[i]];
+            sortedLoudness[i] = loudness[order[i]];
+        }
+
+        noteFrequencies.resize((size_t)numberOfNotes * numberOfPartials);
+        for (int n = 0; n < numberOfNotes; n++)
+            calculateFrequencies(std::pow(2.0f, (float)n / notesPerOctave), &noteFrequencies[(size_t)n * numberOfPartials]);
+
+        table.resize((size_t)numberOfNotes * numberOfNotes);
+        rowValid.assign((size_t)numberOfNotes, false);
+        diagonal.resize((size_t)numberOfNotes);
+        forEachNote([this](int n, int) { diagonal[n] = cross(getFrequencies(n), getFrequencies(n)); });
+
+        scratch.resize((size_t)numberOfPartials);
+        scratchB.resize((size_t)numberOfPartials);
+        return true;
+    }
+
+    int getNumberOfNotes() const { return numberOfNotes; }
+    int getNumberOfPartials() const { return numberOfPartials; }
+
+    //dissonance of note n with itself
+    float getSelf(int n) const { return diagonal[n]; }
+
+    //dissonance between note a and every note on the grid
+    const float* getRow(int a)
+    {
+        float* row = &table[(size_t)a * numberOfNotes];
+        if (! rowValid[a])
+        {
+            const float* freqA = getFrequencies(a);
+            forEachNote([&](int b, int)
+            {
+                if (b == a)
+                    row[b] = diagonal[a];
+                else if (rowValid[b])
+                    row[b] = table[(size_t)b * numberOfNotes + a];
+                else
+                    row[b] = cross(freqA, getFrequencies(b));
+            });
+            rowValid[a] = true;
+        }
+        return row;
+    }
+
+    float get(int a, int b) { return getRow(a)[b]; }
+
+    //same as getRow() for an interval that is not on the grid, nothing is cached
+    void computeRow(float interval, float* row)
+    {
+        calculateFrequencies(interval, scratch.data());
+        forEachNote([&](int b, int) { row[b] = cross(scratch.data(), getFrequencies(b)); });
+    }
+
+    //returns the grid index of an interval or -1 if it is off the grid
+    int getNoteIndex(float interval) const
+    {
+        if (interval <= 0.0f)
+            return -1;
+        float step = std::log2(interval) * notesPerOctave;
+        int n = (int)std::lround(step);
+        if (n < 0 || n >= numberOfNotes || std::abs(step - n) > 1.0e-3f)
+            return -1;
+        return n;
+    }
+
+    //dissonance between two arbitrary intervals (one direction)
+    float computeCross(float intervalA, float intervalB)
+    {
+        calculateFrequencies(intervalA, scratch.data());
+        calculateFrequencies(intervalB, scratchB.data());
+        return cross(scratch.data(), scratchB.data());
+    }
+
+private:
+    template <typename Function>
+    void forEachNote(Function&& function)
+    {
+        auto body = [&](int begin, int end, int worker)
+        {
+            for (int n = begin; n < end; n++)
+                function(n, worker);
+        };
+        if (pool != nullptr)
+            pool->parallelFor(numberOfNotes, 16, body);
+        else
+            body(0, numberOfNotes, 0);
+    }
+
+    const float* getFrequencies(int n) const { return &noteFrequencies[(size_t)n * numberOfPartials]; }
+
+    void calculateFrequencies(float interval, float* freq) const
+    {
+        for (int i = 0; i < numberOfPartials; i++)
+            freq[i] = root * sortedRatios[i] * interval;
+    }
+
+    float cross(const float* freqA, const float* freqB) const
+    {
+        return Roughness::crossDissmeasure(freqA, sortedLoudness.data(), numberOfPartials,
+                                           freqB, sortedLoudness.data(), numberOfPartials);
+    }
+
+    float root = 0.0f;
+    int notesPerOctave = 0;
+    int numberOfNotes = 0;
+    int numberOfPartials = 0;
+    std::vector<float> partialRatios;
+    std::vector<float> loudness;
+    std::vector<int> order;
+    std::vector<float> sortedRatios;
+    std::vector<float> sortedLoudness;
+    std::vector<float> noteFrequencies;
+    std::vector<float> table;
+    std::vector<bool> rowValid;
+    std::vector<float> diagonal;
+    std::vector<float> scratch;
+    std::vector<float> scratchB;
+    int settingsId = -1;
+    WorkerPool* pool = nullptr;
+};
@@ -0,0 +1,125 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include <functional>
+#include <memory>
+
+/*  Calls onFrame() once per display refresh while there is something to do.
+
+    With JUCE 7 or newer the frames come from the display's vblank
+    (juce::VBlankAttachment), before that from a timer at fallbackFrameRate.
+    Whatever piles up between two frames is done in one onFrame(). After a
+    frame without work the clock stops until the next start(). While the
+    component isn't showing (e.g. the window is minimised) no frame is run, the
+    clock only checks hiddenPollRate times per second whether it is shown
+    again.
+*/
+class FrameClock : private juce::Timer
+{
+public:
+    //onFrame() returns false if there was nothing to do
+    FrameClock(juce::Component& component, std::function<bool()> onFrame)
+        : component(component), onFrame(std::move(onFrame)) {}
+
+    ~FrameClock() override { stop(); }
+
+    //message thread, cheap if already running
+    void start()
+    {
+        if (running)
+            return;
+        running = true;
+#if JUCE_MAJOR_VERSION >= 7
+        if (vblank != nullptr)
+            stopTimer(); //cancels a pending detach
+        else
+            timerCallback();
+#else
+        startTimerHz(fallbackFrameRate);
+#endif
+    }
+
+    void stop()
+    {
+        running = false;
+        stopTimer();
+#if JUCE_MAJOR_VERSION >= 7
+        vblank.reset();
+#endif
+    }
+
+    bool isRunning() const noexcept { return running; }
+
+private:
+    static const int fallbackFrameRate = 60;
+    static const int hiddenPollRate = 4;
+
+    void frame()
+    {
+        if (! running)
+            return;
+        if (! component.isShowing())
+        {
+            if (getTimerInterval() != 1000 / hiddenPollRate)
+                startTimerHz(hiddenPollRate); //with vblank: detaches in timerCallback(), not inside its own callback
+            return;
+        }
+#if JUCE_MAJOR_VERSION < 7
+        if (getTimerInterval() != 1000 / fallbackFrameRate)
+            startTimerHz(fallbackFrameRate);
+#endif
+        if (! onFrame())
+        {
+            running = false;
+#if JUCE_MAJOR_VERSION >= 7
+            startTimer(1);
+#else
+            stopTimer();
+#endif
+        }
+    }
+
+    void timerCallback() override
+    {
+#if JUCE_MAJOR_VERSION >= 7
+        if (running && component.isShowing())
+        {
+            stopTimer();
+            if (vblank == nullptr)
+                vblank.reset(new juce::VBlankAttachment(&component, [this] { frame(); }));
+            return;
+        }
+        vblank.reset();
+        if (running)
+        {
+            if (getTimerInterval() != 1000 / hiddenPollRate)
+                startTimerHz(hiddenPollRate);
+        }
+        else
+        {
+            stopTimer();
+        }
+#else
+        frame();
+#endif
+    }
+
+    juce::Component& component;
+    std::function<bool()> onFrame;
+    bool running = false;
+#if JUCE_MAJOR_VERSION >= 7
+    std::unique_ptr<juce::VBlankAttachment> vblank;
+#endif
+};
@@ -12,6 +12,10 @@
 */
 
 #include <JuceHeader.h>
+#if JUCE_DEBUG
+ #define SHADES_DEFINE_ALLOCATION_HOOKS 1
+#endif
+#include "AllocationCounter.h"
 #include "MultiTouchMainComponent.h"
 
 class Application    : public juce::JUCEApplication
@@ -13,21 +13,30 @@
 
 
 #pragma once
-#include "SineOscillator.h"
+#include "VoicePool.h"
+#include "SpectrumPresets.h"
 #include "BackgroundVisualisation.h"
 #include "Note.h"
 #include "DissonanceCurve.h"
 #include "Spectrum.h"
+#include "DissonanceAnalyser.h"
+#include "SpectrumOptimiser.h"
+#include "TripleBuffer.h"
+#include "SpscQueue.h"
+#include "AudioRenderWorkers.h"
+#include "AudioCallbackStats.h"
+#include "FrameClock.h"
 
 //==============================================================================
 class MultiTouchMainComponent : public juce::AudioAppComponent,
-                                public juce::MultiTimer
+                                public juce::MultiTimer,
+                                private juce::AsyncUpdater
 {
 public:
     MultiTouchMainComponent()
     {
         /********************** Initialize Member Variables ********************************/
-        numberOfIntervals = 10;  //#notes you can play simultaneously
+        numberOfIntervals = numberOfVoices;  //#notes you can play simultaneously, every voice can be held by a finger
         notesPerOct = 120; //BUG: initialize notesPerOct with maxNotesPerOct => otherwise Error
         octaves = 6;
         numberOfNotes = notesPerOct * octaves;
@@ -37,9 +46,12 @@ public:
         numberOfPartials = 8;
         freq.resize(numberOfIntervals, 0.0f);
         intervals.resize(numberOfIntervals, 0.0f);
+        fingerSources.resize(numberOfIntervals, -1);
         maxPartialRatios.resize(maxNumberOfPartials, 0.0f);
         maxAmplitudes.resize(maxNumberOfPartials, 0.0f);
+        levelAmplitudes.resize(maxNumberOfPartials, 0.0f);
         currentSampleRate = 0.0f;
+        level = 0.0f;
         spectrumId = 1;
 
         // choose other (inharmonic) spectrum here:
@@ -50,9 +62,7 @@ public:
         calculateLevel();*/
 
         /********************** backgroundVisualisation ********************************/
-        std::vector<float> partialRatios(numberOfPartials, 0.0f);
-        std::vector<float> amplitudes(numberOfPartials, 0.0f);
-        backgroundVisualisation.reset(new BackgroundVisualisation(numberOfIntervals, octaves, notesPerOct, root, partialRatios, amplitudes));
+        backgroundVisualisation.reset(new BackgroundVisualisation(octaves, notesPerOct));
         addAndMakeVisible(backgroundVisualisation.get());
         backgroundVisualisation->setInterceptsMouseClicks(false, true);
 
@@ -61,11 +71,13 @@ public:
         addAndMakeVisible(squareButton);
         addAndMakeVisible(triangleButton);
         addAndMakeVisible(randomButton);
+        addAndMakeVisible(snapSpectrumButton);
         addAndMakeVisible(optimizeSpectrumButton);
         sawtoothButton.setClickingTogglesState(true);
         squareButton.setClickingTogglesState(true);
         triangleButton.setClickingTogglesState(true);
         randomButton.setClickingTogglesState(true);
+        snapSpectrumButton.setClickingTogglesState(true);
         optimizeSpectrumButton.setClickingTogglesState(true);
         sawtoothButton.onClick = [this] { 
             if (sawtoothButton.getToggleState())
@@ -92,48 +104,79 @@ public:
             spectrumId = 4;
             calculateSpectrum();
         };
-        optimizeSpectrumButton.onClick = [this] {
-            if (optimizeSpectrumButton.getToggleState())
+        snapSpectrumButton.onClick = [this] {
+            if (snapSpectrumButton.getToggleState())
             {
                 spectrumId = 5;
                 calculateSpectrum();
             }
         };
+        optimizeSpectrumButton.onClick = [this] {
+            if (optimizeSpectrumButton.getToggleState())
+            {
+                spectrumId = 6;
+                calculateSpectrum(); //starts the optimiser
+            }
+        };
+        addAndMakeVisible(fastRoughnessButton);
+        fastRoughnessButton.setClickingTogglesState(true);
+        fastRoughnessButton.onClick = [this] {
+            Roughness::setFastMode(fastRoughnessButton.getToggleState());
+            markDirty(DissonanceAnalyser::updateMap | DissonanceAnalyser::updateCurve);
+        };
+        addAndMakeVisible(parallelAudioButton);
+        parallelAudioButton.setClickingTogglesState(true);
+        parallelAudioButton.onClick = [this] {
+            renderWorkers->setEnabled(parallelAudioButton.getToggleState());
+        };
+        addAndMakeVisible(continuousPitchButton);
+        continuousPitchButton.setClickingTogglesState(true);
+        continuousPitchButton.onClick = [this] {
+            updateFrequency(); //the held notes snap to the grid or leave it
+            markDirty(DissonanceAnalyser::updateMap);
+        };
+        addAndMakeVisible(spectralSynthButton);
+        spectralSynthButton.setClickingTogglesState(true);
+        spectralSynthButton.onClick = [this] {
+            publishSynthParameters();
+        };
         sawtoothButton.setRadioGroupId(1);
         squareButton.setRadioGroupId(1);
         triangleButton.setRadioGroupId(1);
         randomButton.setRadioGroupId(1);
+        snapSpectrumButton.setRadioGroupId(1);
         optimizeSpectrumButton.setRadioGroupId(1);
         sawtoothButton.triggerClick(); //sawtooth = default
 
         /********************** ComboBoxes ********************************/
         addAndMakeVisible(selectOctaves);
-        for (int i = 1; i <= 6; i++)
+        for (int i = 1; i <= maxOctaves; i++)
             selectOctaves.addItem(juce::String(i), i);
 
         selectOctaves.onChange = [this] 
         {
             octaves = selectOctaves.getSelectedId();
-            backgroundVisualisation->setOctaves(octaves);
             numberOfNotes = notesPerOct * octaves;
+            markDirty(DissonanceAnalyser::updateMap);
         };
         selectOctaves.setSelectedId(2);
 
         addAndMakeVisible(selectNotesPerOct);
-        for (int i = 2; i <= 120; i++)
+        for (int i = 2; i <= maxNotesPerOct; i++)
             selectNotesPerOct.addItem(juce::String(i), i);
 
         selectNotesPerOct.onChange = [this] 
         {
             notesPerOct = selectNotesPerOct.getSelectedId();
-            backgroundVisualisation->setNotesPerOctave(notesPerOct);
             dissonanceCurve->setNotesPerOctave(notesPerOct);
             numberOfNotes = notesPerOct * octaves;
-            if (optimizeSpectrumButton.getToggleState())
+            markDirty(DissonanceAnalyser::updateMap);
+            if (snapSpectrumButton.getToggleState())
             {
                 spectrumId = 5;
                 calculateSpectrum();
             }
+            restartOptimiser(); //new steps
         };
         selectNotesPerOct.setSelectedId(12);
 
@@ -146,24 +189,18 @@ public:
             lowestOctave = selectLowestOctave.getSelectedId() - 5;
             root = (float)tuningSlider.getValue() * std::pow(2.0f, (float)lowestOctave);
             updateFrequency();
-            backgroundVisualisation->setRoot(root);
-            dissonanceCurve->setRoot(root);
+            markDirty(DissonanceAnalyser::updateMap | DissonanceAnalyser::updateCurve);
+            restartOptimiser();
         };
         selectLowestOctave.setSelectedId(3);
 
         addAndMakeVisible(selectNumbOfPartials);
-        for (int i = 1; i <= 20; i++)
+        for (int i = 1; i <= maxNumberOfPartials; i++)
             selectNumbOfPartials.addItem(juce::String(i), i);
 
         selectNumbOfPartials.onChange = [this] 
         {
             numberOfPartials = std::min(maxNumberOfPartials, selectNumbOfPartials.getSelectedId());
-            std::vector<float> partialRatios = { maxPartialRatios.begin(), maxPartialRatios.begin() + numberOfPartials };
-            std::vector<float> amplitudes = { maxAmplitudes.begin(), maxAmplitudes.begin() + numberOfPartials };
-            backgroundVisualisation->setPartialRatios(partialRatios);
-            backgroundVisualisation->setAmplitudes(amplitudes);
-            dissonanceCurve->setPartialRatios(partialRatios);
-            dissonanceCurve->setAmplitudes(amplitudes);
             calculateSpectrum();
         };
         selectNumbOfPartials.setSelectedId(20);
@@ -187,6 +224,8 @@ public:
         selectNumbOfPartialsLabel.setText("#Partials for Calculation", juce::dontSendNotification);
         selectNumbOfPartialsLabel.attachToComponent(&selectNumbOfPartials, false);
         addAndMakeVisible(currentDissonanceLabel);
+        addChildComponent(audioStatsLabel); //shown with the L key
+        audioStatsLabel.setFont(11.0f);
 
         /********************** Sliders ********************************/
         addAndMakeVisible(tuningSlider);
@@ -199,12 +238,12 @@ public:
             tuning = (float)tuningSlider.getValue();
             root = tuning * std::pow(2.0f, (float)lowestOctave);
             updateFrequency();
-            backgroundVisualisation->setRoot(root);
-            dissonanceCurve->setRoot(root);
+            markDirty(DissonanceAnalyser::updateMap | DissonanceAnalyser::updateCurve);
+            restartOptimiser();
         };
         
         /********************** dissonanceCurve ********************************/
-        dissonanceCurve.reset(new DissonanceCurve(notesPerOct, root, partialRatios, amplitudes));
+        dissonanceCurve.reset(new DissonanceCurve(notesPerOct));
         addAndMakeVisible(dissonanceCurve.get());
 
         /********************** spectrum ********************************/
@@ -223,80 +262,50 @@ public:
      
         setSize(1300, 700);
         setWantsKeyboardFocus(true);
+        renderWorkers.reset(new AudioRenderWorkers(juce::jlimit(0, 3, juce::SystemStats::getNumCpus() - 2))); //one core stays with the message thread
         setAudioChannels (0, 2); // no inputs, two outputs
-        startTimer(1, 50);
-        startTimer(2, 500);
+        analyser.reset(new DissonanceAnalyser(numberOfIntervals, maxNumberOfPartials, maxNotesPerOct * maxOctaves, *this));
+        optimiser.reset(new SpectrumOptimiser(*this));
+        markDirty(DissonanceAnalyser::updateMap | DissonanceAnalyser::updateCurve);
     }
     ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     ////////////////////////////////// END OF CONSTRUCTOR /////////////////////////////////////////////////////////////////
     ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-    ~MultiTouchMainComponent() override { shutdownAudio(); }
+    ~MultiTouchMainComponent() override 
+    { 
+        frameClock.stop();
+        stopTimer(2);
+        optimiser = nullptr;
+        analyser = nullptr;
+        const int xruns = getXRunCount();
+        shutdownAudio(); 
+        writeAudioStats(xruns);
+    }
 
     void paint(juce::Graphics& g) override {}
 
     void calculateLevel()
     {
-        float sumOfAmplitudes = 0.0f;
-        for (int i = 0; i < maxNumberOfPartials; ++i)
-            sumOfAmplitudes += maxAmplitudes[i];
-
-        level = 1.0f / (numberOfIntervals * sumOfAmplitudes);
+        level = SpectrumPresets::calculateLevel(maxAmplitudes, numberOfPartials, levelFingers);
     }
 
     void calculateSpectrum()
     {
-        if (spectrumId == 1) // sawtooth
-        {
-            for (int i = 0; i < maxNumberOfPartials; ++i)
-            {
-                maxPartialRatios[i] = i + 1.0f;
-                maxAmplitudes[i] = 1.0f / (i + 1.0f);
-            }
-        }
-        else if (spectrumId == 2) // square
+        SpectrumPresets::calculate(spectrumId, numberOfPartials, notesPerOct, maxPartialRatios, maxAmplitudes,
+                                   [] { return juce::Random::getSystemRandom().nextFloat(); });
+        if (optimiser != nullptr)
         {
-            for (int i = 0; i < maxNumberOfPartials; ++i)
-            {
-                maxPartialRatios[i] = 2.0f * i + 1.0f;
-                maxAmplitudes[i] = 1.0f / (i + 1.0f);
-            }
+            if (spectrumId == SpectrumPresets::optimised)
+                optimiser->start(root, notesPerOct, maxPartialRatios, maxAmplitudes, numberOfPartials);
+            else
+                optimiser->cancel();
         }
-        else if (spectrumId == 3) // triangle
-        {
-            for (int i = 0; i < maxNumberOfPartials; ++i)
-            {
-                maxPartialRatios[i] = 2.0f * i + 1.0f;
-                maxAmplitudes[i] = 1.0f / std::pow(i + 1.0f, 2.0f);
-            }
-        }
-        else if (spectrumId == 4) // random
-        {
-            for (int i = 0; i < maxNumberOfPartials; ++i)
-            {
-                maxPartialRatios[i] = juce::Random::getSystemRandom().nextFloat() * maxNumberOfPartials;
-                maxAmplitudes[i] = juce::Random::getSystemRandom().nextFloat();
-            }
-        }
-        else if (spectrumId == 5) // optimize Spectrum for Equal Temperaments (Sethares p. 247)
-        { 
-            const float s = std::pow(2.0f, 1.0f / notesPerOct);
-            for (int i = 0; i < maxNumberOfPartials; ++i)
-            {
-                float exponent = std::round(std::log10(i + 1.0f) / std::log10(s)); //s^x = z  =>  x = log(z)/log(s)
-                maxPartialRatios[i] = std::pow(s, exponent);
-                maxAmplitudes[i] = 1.0f / (i + 1.0f);
-            }
-        }
-        std::vector<float> partialRatios = { maxPartialRatios.begin(), maxPartialRatios.begin() + numberOfPartials };
-        std::vector<float> amplitudes = { maxAmplitudes.begin(), maxAmplitudes.begin() + numberOfPartials };
-        backgroundVisualisation->setPartialRatios(partialRatios);
-        backgroundVisualisation->setAmplitudes(amplitudes);
-        dissonanceCurve->setPartialRatios(partialRatios);
-        dissonanceCurve->setAmplitudes(amplitudes);
         spectrum->setPartialRatios(maxPartialRatios);
         spectrum->setAmplitudes(maxAmplitudes);
         spectrum->repaint();
         calculateLevel();
+        publishSynthParameters();
+        markDirty(DissonanceAnalyser::updateMap | DissonanceAnalyser::updateCurve);
     }
 
     void resized() override
@@ -311,120 +320,378 @@ public:
         squareButton.setBounds(530, 50, 70, 30);
         triangleButton.setBounds(615, 10, 70, 30);
         randomButton.setBounds(615, 50, 70, 30);
-        optimizeSpectrumButton.setBounds(530, 90, 155, 30);
+        snapSpectrumButton.setBounds(530, 90, 70, 30);
+        optimizeSpectrumButton.setBounds(615, 90, 70, 30);
+        fastRoughnessButton.setBounds(190, 120, 120, 30);
+        spectralSynthButton.setBounds(320, 120, 120, 30);
+        parallelAudioButton.setBounds(450, 120, 120, 30);
         backgroundVisualisation->setBounds(0, 160, getWidth(), getHeight() - 160);
         dissonanceCurve->setBounds(700, 10, 280, 140);
         spectrum->setBounds(990, 10, 280, 140);
         currentDissonanceLabel.setBounds(10, 120, 170, 30);
+        continuousPitchButton.setBounds(580, 120, 110, 30);
+        audioStatsLabel.setBounds(getWidth() - 125, 190, 115, 30);
 
-        for (auto i = 0; i < numberOfIntervals; i++)
-        {
-            int newX = (int)notes[i]->getPosition().getX() - (int)(NOTE_DIAMETER / 2);
-            int newY = (int)notes[i]->getPosition().getY() - (int)(NOTE_DIAMETER / 2);
-            notes[i]->setBounds(newX, newY, NOTE_DIAMETER, NOTE_DIAMETER);
-        }
+        placeNotes();
+        if (continuousPitchButton.getToggleState())
+            markDirty(DissonanceAnalyser::updateMap); //one value per pixel
     }
 
     void mouseDown(const juce::MouseEvent& event) override
     {
-        int noteIndex = event.source.getIndex();
+        int noteIndex = getNoteIndex(event.source.getIndex(), true);
+        if (noteIndex < 0) //every note on screen is held
+            return;
         notes[noteIndex]->updatePosition(event.position);
         updateFrequency();
-        int newX = (int)notes[noteIndex]->getPosition().getX() - (int)(NOTE_DIAMETER / 2);
-        int newY = (int)notes[noteIndex]->getPosition().getY() - (int)(NOTE_DIAMETER / 2);
-        notes[noteIndex]->setBounds(newX, newY, NOTE_DIAMETER, NOTE_DIAMETER);
+        notesMoved = true; //the sound follows at once, the picture with the next frame
+        frameClock.start();
     }
 
     void mouseDrag(const juce::MouseEvent& event) override
     {
-        int noteIndex = event.source.getIndex();
+        int noteIndex = getNoteIndex(event.source.getIndex(), false);
+        if (noteIndex < 0) //a finger that didn't get a note
+            return;
         notes[noteIndex]->updatePosition(event.position);
         updateFrequency();
-        int newX = (int)notes[noteIndex]->getPosition().getX() - (int)(NOTE_DIAMETER / 2);
-        int newY = (int)notes[noteIndex]->getPosition().getY() - (int)(NOTE_DIAMETER / 2);
-        notes[noteIndex]->setBounds(newX, newY, NOTE_DIAMETER, NOTE_DIAMETER);
+        notesMoved = true;
+        frameClock.start();
     }
 
     void mouseUp(const juce::MouseEvent& event) override
     {
-        int noteIndex = event.source.getIndex();
+        int noteIndex = getNoteIndex(event.source.getIndex(), false);
+        if (noteIndex < 0)
+            return;
+        fingerSources[noteIndex] = -1;
         notes[noteIndex]->reset();
         updateFrequency();
-        int newX = (int)notes[noteIndex]->getPosition().getX() - (int)(NOTE_DIAMETER / 2);
-        int newY = (int)notes[noteIndex]->getPosition().getY() - (int)(NOTE_DIAMETER / 2);
-        notes[noteIndex]->setBounds(newX, newY, NOTE_DIAMETER, NOTE_DIAMETER);
+        notesMoved = true;
+        frameClock.start();
+    }
+
+    //the note a touch source holds, or with take a free one for it => -1 if there is none
+    int getNoteIndex(int source, bool take)
+    {
+        for (int i = 0; i < numberOfIntervals; i++)
+            if (fingerSources[i] == source)
+                return i;
+        if (take)
+        {
+            for (int i = 0; i < numberOfIntervals; i++)
+            {
+                if (fingerSources[i] < 0)
+                {
+                    fingerSources[i] = source;
+                    return i;
+                }
+            }
+        }
+        return -1;
+    }
+
+    //stale outputs are recomputed at most once per frame => no frames run while nothing is stale
+    void markDirty(int outputs)
+    {
+        dirtyOutputs |= outputs;
+        frameClock.start();
+    }
+
+    //everything visual that piled up since the last display frame, in one pass
+    bool renderFrame()
+    {
+        const bool hadWork = dirtyOutputs != 0 || resultPending || notesMoved;
+        if (dirtyOutputs != 0)
+        {
+            requestAnalysis(dirtyOutputs);
+            dirtyOutputs = 0;
+        }
+        if (resultPending)
+        {
+            resultPending = false;
+            showOptimisedSpectrum();
+            showLatestResult();
+        }
+        if (notesMoved)
+        {
+            notesMoved = false;
+            placeNotes();
+        }
+        return hadWork;
+    }
+
+    void placeNotes()
+    {
+        for (auto i = 0; i < numberOfIntervals; i++)
+        {
+            int newX = (int)notes[i]->getPosition().getX() - (int)(NOTE_DIAMETER / 2);
+            int newY = (int)notes[i]->getPosition().getY() - (int)(NOTE_DIAMETER / 2);
+            notes[i]->setBounds(newX, newY, NOTE_DIAMETER, NOTE_DIAMETER);
+        }
     }
 
     void timerCallback(int timerID) override
     {
-        if (timerID == 1) 
+        if (timerID == 2) //only runs while the stats are shown
+        {
+            audioStatsLabel.setText("p50 " + juce::String(juce::roundToInt(callbackStats.getPercentile(0.5)))
+                                    + " p99 " + juce::String(juce::roundToInt(callbackStats.getPercentile(0.99)))
+                                    + " max " + juce::String(juce::roundToInt(callbackStats.getMaxMicroseconds()))
+                                    + " of " + juce::String(juce::roundToInt(callbackStats.getBudgetMicroseconds())) + " us\n"
+                                    + "misses " + juce::String(callbackStats.getDeadlineMisses()) + " xruns " + juce::String(getXRunCount()),
+                                    juce::dontSendNotification);
+        }
+    }
+
+    bool keyPressed(const juce::KeyPress& key) override
+    {
+        if (key.getTextCharacter() == 'l' || key.getTextCharacter() == 'L')
+        {
+            audioStatsLabel.setVisible(! audioStatsLabel.isVisible());
+            if (audioStatsLabel.isVisible())
+            {
+                timerCallback(2);
+                startTimer(2, 250);
+            }
+            else
+            {
+                stopTimer(2); //hidden => no periodic work, the audio thread keeps counting
+            }
+            return true;
+        }
+        return false;
+    }
+
+    //-1 => the device doesn't count them
+    int getXRunCount()
+    {
+        auto* device = deviceManager.getCurrentAudioDevice();
+        return device != nullptr ? device->getXRunCount() : -1;
+    }
+
+    //next to the app's settings, overwritten on every exit
+    void writeAudioStats(int xruns)
+    {
+        if (callbackStats.getNumberOfBlocks() == 0)
+            return;
+        auto folder = juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory).getChildFile("MultiTouchInstrument");
+        if (folder.createDirectory().wasOk())
+            folder.getChildFile("AudioCallbackStats.json").replaceWithText(callbackStats.toJson(xruns));
+    }
+
+    //snapshot of everything the analysis thread needs => the results come back in handleAsyncUpdate()
+    void requestAnalysis(int work)
+    {
+        analysisRequest.root = root;
+        analysisRequest.notesPerOctave = notesPerOct;
+        analysisRequest.octaves = octaves;
+        analysisRequest.partialRatios.assign(maxPartialRatios.begin(), maxPartialRatios.begin() + numberOfPartials);
+        analysisRequest.amplitudes.assign(maxAmplitudes.begin(), maxAmplitudes.begin() + numberOfPartials);
+        analysisRequest.intervals = intervals;
+        analysisRequest.continuous = continuousPitchButton.getToggleState();
+        analysisRequest.width = backgroundVisualisation->getWidth();
+        analyser->request(analysisRequest, work);
+    }
+
+    //a new analysis or optimiser result => shown with the next frame
+    void handleAsyncUpdate() override
+    {
+        resultPending = true;
+        frameClock.start();
+    }
+
+    void showLatestResult()
+    {
+        const AnalysisResult* result = analyser->getLatestResult();
+        if (result == nullptr)
+            return;
+
+        if (result->mapFrame != lastMapFrame)
         {
-            backgroundVisualisation->update();
-            float currentDissonance = backgroundVisualisation->getCurrentDissonance();
-            currentDissonanceLabel.setText("Current Dissonance: " + juce::String(currentDissonance, 3), juce::dontSendNotification);
+            lastMapFrame = result->mapFrame;
+            backgroundVisualisation->setDissonances(result->map, result->octaves, result->currentDissonance);
+            currentDissonanceLabel.setText("Current Dissonance: " + juce::String(result->currentDissonance, 3), juce::dontSendNotification);
         }
-        else if (timerID == 2)
+        if (result->curveFrame != lastCurveFrame)
         {
-            dissonanceCurve->update();
+            lastCurveFrame = result->curveFrame;
+            dissonanceCurve->setDissonances(result->curve, result->minima);
         }
     }
 
+    //settings the optimised spectrum depends on changed => starts over from the snapped one
+    void restartOptimiser()
+    {
+        if (spectrumId == SpectrumPresets::optimised)
+            calculateSpectrum();
+    }
+
+    //the best spectrum of the optimiser so far => shown and played like a preset
+    void showOptimisedSpectrum()
+    {
+        const OptimiserResult* result = optimiser->getLatestResult();
+        if (result == nullptr || spectrumId != SpectrumPresets::optimised || (int)result->partialRatios.size() != numberOfPartials)
+            return;
+
+        std::copy(result->partialRatios.begin(), result->partialRatios.end(), maxPartialRatios.begin());
+        std::copy(result->amplitudes.begin(), result->amplitudes.end(), maxAmplitudes.begin());
+        spectrum->setPartialRatios(maxPartialRatios);
+        spectrum->setAmplitudes(maxAmplitudes);
+        spectrum->repaint();
+        calculateLevel();
+        publishSynthParameters();
+        markDirty(DissonanceAnalyser::updateMap | DissonanceAnalyser::updateCurve);
+    }
+
     void updateFrequency()
     {
+        bool intervalsChanged = false;
+        const double now = juce::Time::getMillisecondCounterHiRes();
         for (int i = 0; i < numberOfIntervals; i++) 
         {
+            float oldInterval = intervals[i];
+            float oldFreq = freq[i];
             float newX = notes[i]->getPosition().getX();
             if (newX < 0.0f) 
             {
                 intervals[i] = -1.0f;
                 freq[i] = 0.0f;
             }
+            else if (continuousPitchButton.getToggleState())
+            {
+                intervals[i] = std::pow(2.0f, octaves * newX / getWidth());
+                freq[i] = intervals[i] * root;
+            }
             else 
             {
                 float scaleStep = std::floor(numberOfNotes * newX / getWidth());
                 intervals[i] = std::pow(2.0f, scaleStep / notesPerOct);
                 freq[i] = intervals[i] * root;
             }
+            intervalsChanged = intervalsChanged || intervals[i] != oldInterval;
+            if (freq[i] != oldFreq && ! touchEvents.push({ i, freq[i], now }))
+                touchEventsLost = true; //=> the audio thread takes all frequencies from the next parameter block
         }
-        backgroundVisualisation->setIntervals(intervals);
+        publishSynthParameters();
+        if (intervalsChanged)
+            markDirty(DissonanceAnalyser::updateMap);
     }
 
-    void prepareToPlay (int, double sampleRate) override
+    //message thread only => the audio thread picks up the newest complete block in getNextAudioBlock()
+    void publishSynthParameters()
     {
+        SynthParameters& parameters = synthParameters.getWriteBuffer();
+        parameters.freq = freq;
+        parameters.partialRatios = maxPartialRatios;
+        parameters.amplitudes = maxAmplitudes;
+        parameters.level = level;
+        parameters.numberOfPartials = numberOfPartials;
+        parameters.spectral = spectralSynthButton.getToggleState();
+        synthParameters.publish();
+    }
+
+    void prepareToPlay (int samplesPerBlockExpected, double sampleRate) override
+    {
+        //also called when the device restarts => everything is rebuilt to the same size, nothing accumulates
         currentSampleRate = (float)sampleRate;
-        for (auto i = 0; i < numberOfIntervals * maxNumberOfPartials; ++i) 
-        {
-            auto* oscillator = new SineOscillator();
-            oscillators.add(oscillator);
-        } 
+        voicePool.prepare(numberOfVoices, numberOfIntervals, maxNumberOfPartials, currentSampleRate);
+        renderWorkers->prepare(samplesPerBlockExpected);
+        spectralSynth.setNumberOfOscillators(numberOfVoices * maxNumberOfPartials);
+        spectralSynth.setSampleRate(currentSampleRate);
     }
 
     void releaseResources() override {}
 
     void getNextAudioBlock (const juce::AudioSourceChannelInfo& bufferToFill) override
     {
+        AudioCallbackStats::Scope timing(callbackStats, bufferToFill.numSamples, currentSampleRate);
+        const double now = juce::Time::getMillisecondCounterHiRes();
         auto* leftBuffer  = bufferToFill.buffer->getWritePointer (0, bufferToFill.startSample);
         auto* rightBuffer = bufferToFill.buffer->getWritePointer (1, bufferToFill.startSample);
 
         bufferToFill.clearActiveBufferRegion();
 
-        for (auto noteIndex = 0; noteIndex < numberOfIntervals; ++noteIndex)
+        synthParameters.acquire(); //keeps the last block if nothing new was published
+        const SynthParameters& parameters = synthParameters.getReadBuffer();
+        if ((int)parameters.freq.size() != numberOfIntervals || renderWorkers->getMaxBlockSize() == 0)
+            return; //nothing published or not prepared yet
+
+        for (int partial = 0; partial < maxNumberOfPartials; ++partial)
+            levelAmplitudes[partial] = parameters.level * parameters.amplitudes[partial];
+
+        if (touchEventsLost.exchange(false))
         {
-            for (int partial = 0; partial < numberOfPartials; ++partial) //replace with maxNumberOfPartials => all partials are played
-            {
-                auto* oscillator = oscillators.getUnchecked((noteIndex * maxNumberOfPartials) + partial);
-                oscillator->setFrequency(freq[noteIndex] * maxPartialRatios[partial], currentSampleRate);
-                for (auto sample = 0; sample < bufferToFill.numSamples; ++sample)
-                {
-                    auto levelSample = oscillator->getNextSample() * level * maxAmplitudes[partial];
-                    leftBuffer[sample] += levelSample;
-                    rightBuffer[sample] += levelSample;
-                }
-            }
+            TouchEvent lost;
+            while (touchEvents.pop(lost)) {}
+            voicePool.setFingerFrequencies(parameters.freq);
+        }
+
+        //every touch event is applied at its own sample, one block after it happened
+        //=> constant latency instead of jumping to the block boundary
+        const int numSamples = bufferToFill.numSamples;
+        renderDeadline = now + 750.0 * numSamples / currentSampleRate; //a quarter of the block stays for the rest of the chain
+        int position = 0;
+        TouchEvent event;
+        while (touchEvents.pop(event))
+        {
+            int offset = numSamples - (int)((now - event.time) * 0.001 * currentSampleRate);
+            offset = juce::jlimit(position, numSamples, offset);
+            if (! parameters.spectral)
+                renderVoices(leftBuffer + position, offset - position, parameters);
+            voicePool.setFingerFrequency(event.finger, event.frequency);
+            position = offset;
         }
+
+        if (parameters.spectral) //the IFFT engine costs about the same for any number of partials per voice
+        {
+            voicePool.renderSpectral(spectralSynth, numSamples, parameters.partialRatios.data(), levelAmplitudes.data(), parameters.numberOfPartials);
+            spectralSynth.render(leftBuffer, numSamples);
+        }
+        else
+        {
+            renderVoices(leftBuffer + position, numSamples - position, parameters);
+        }
+        std::copy(leftBuffer, leftBuffer + bufferToFill.numSamples, rightBuffer);
     }
 
 private:
+    //everything getNextAudioBlock() reads, written as a whole by the message thread
+    struct SynthParameters
+    {
+        std::vector<float> freq;
+        std::vector<float> partialRatios;
+        std::vector<float> amplitudes;
+        float level = 0.0f;
+        int numberOfPartials = 0;
+        bool spectral = false;
+    };
+
+    //a finger moved to a new frequency (0 => lifted), time in ms of getMillisecondCounterHiRes()
+    struct TouchEvent
+    {
+        int finger;
+        float frequency;
+        double time;
+    };
+
+    //only voices with a finger down or a release still running are rendered, in parallel mode spread over the render workers
+    //partials above numberOfPartials are silent (maxNumberOfPartials would play all)
+    void renderVoices(float* output, int numSamples, const SynthParameters& parameters)
+    {
+        const int maxBlockSize = renderWorkers->getMaxBlockSize();
+        for (int start = 0; start < numSamples; start += maxBlockSize)
+        {
+            int length = std::min(maxBlockSize, numSamples - start);
+            renderWorkers->forkJoin(voicePool.getNumberOfSoundingVoices(), output + start, length, renderDeadline,
+                                    [&](int item, float* buffer, float* scratch) {
+                                        voicePool.renderSoundingVoice(item, buffer, scratch, length, parameters.partialRatios.data(),
+                                                                      levelAmplitudes.data(), parameters.numberOfPartials);
+                                    });
+            voicePool.removeSilentVoices();
+        }
+    }
+
     juce::Slider tuningSlider;
     juce::Label tuningSliderLabel;
     juce::Label userInstructions;
@@ -433,6 +700,7 @@ private:
     juce::Label selectLowestOctaveLabel;
     juce::Label selectNumbOfPartialsLabel;
     juce::Label currentDissonanceLabel;
+    juce::Label audioStatsLabel;
     juce::ComboBox selectNotesPerOct;
     juce::ComboBox selectOctaves;
     juce::ComboBox selectLowestOctave;
@@ -441,11 +709,33 @@ private:
     juce::TextButton squareButton{ "Square" };
     juce::TextButton triangleButton{ "Triangle" };
     juce::TextButton randomButton{ "Random" };
-    juce::TextButton optimizeSpectrumButton{ "Optimize Spectrum" };
+    juce::TextButton snapSpectrumButton{ "Snap EDO" };
+    juce::TextButton optimizeSpectrumButton{ "Optimize" };
+    juce::TextButton fastRoughnessButton{ "Fast Roughness" };
+    juce::TextButton spectralSynthButton{ "IFFT Synthesis" };
+    juce::TextButton parallelAudioButton{ "Parallel Audio" };
+    juce::TextButton continuousPitchButton{ "Continuous Pitch" };
     std::unique_ptr<BackgroundVisualisation> backgroundVisualisation;
     std::unique_ptr<DissonanceCurve> dissonanceCurve;
     std::unique_ptr<Spectrum> spectrum;
-    juce::OwnedArray<SineOscillator> oscillators;
+    std::unique_ptr<DissonanceAnalyser> analyser;
+    std::unique_ptr<SpectrumOptimiser> optimiser;
+    AnalysisRequest analysisRequest;
+    int lastMapFrame = 0;
+    int lastCurveFrame = 0;
+    int dirtyOutputs = 0;
+    bool resultPending = false;
+    bool notesMoved = false;
+    FrameClock frameClock { *this, [this] { return renderFrame(); } };
+    VoicePool voicePool;
+    std::unique_ptr<AudioRenderWorkers> renderWorkers;
+    double renderDeadline = 0.0;
+    AudioCallbackStats callbackStats;
+    std::vector<float> levelAmplitudes;
+    SpectralSynth spectralSynth;
+    TripleBuffer<SynthParameters> synthParameters;
+    SpscQueue<TouchEvent, 1024> touchEvents;
+    std::atomic<bool> touchEventsLost { false };
     juce::OwnedArray<Note> notes;
     int numberOfIntervals;
     int notesPerOct;
@@ -457,11 +747,17 @@ private:
     int numberOfPartials;
     std::vector<float> freq;
     std::vector<float> intervals;
+    std::vector<int> fingerSources; //touch source index of each note, -1 => free
     std::vector<float> maxPartialRatios;
     std::vector<float> maxAmplitudes;
     float currentSampleRate;
     float level;
     int spectrumId;
-    const int maxNumberOfPartials = 20;
+    const int maxNumberOfPartials = 100;
+    const int maxNotesPerOct = 120;
+    const int maxOctaves = 6;
+    static constexpr int numberOfVoices = 32; //the polyphony: voices in the pool = notes on screen, shared by held fingers and releases
+    static_assert(numberOfVoices >= 32 && numberOfVoices <= 64, "the voice pool is meant for 32...64 voices");
+    static constexpr int levelFingers = 10; //two hands => the output level leaves headroom for this many full notes
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MultiTouchMainComponent)
 };
@@ -0,0 +1,130 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#include "OscillatorBank.h"
+
+void OscillatorBank::render(float* output, int numSamples) noexcept
+{
+    renderList.clear();
+    for (auto& group : groups)
+    {
+        bool active = false;
+        group.ramping = false;
+        for (int l = 0; l < lanes; l++)
+        {
+            active = active || group.amplitude[l] != 0.0f || group.amplitudeStep[l] != 0.0f;
+            group.ramping = group.ramping || group.amplitudeStep[l] != 0.0f || group.sinChirp[l] != 0.0f;
+        }
+        if (active)
+            renderList.push_back(&group);
+    }
+    if (renderList.empty())
+        return;
+
+    for (int start = 0; start < numSamples; start += tileSamples)
+    {
+        const int n = std::min(tileSamples, numSamples - start);
+        std::fill(tile, tile + n * lanes, 0.0f);
+        for (Group* group : renderList)
+        {
+            if (group->ramping)
+                renderRampingGroup(*group, n);
+            else
+                renderGroup(*group, n);
+        }
+
+        for (int sample = 0; sample < n; sample++)
+        {
+            float out = 0.0f;
+            for (int l = 0; l < lanes; l++)
+                out += tile[sample * lanes + l];
+            output[start + sample] += out;
+        }
+    }
+
+    for (Group* group : renderList) //one Newton step towards 1 / length
+    {
+        for (int l = 0; l < lanes; l++)
+        {
+            float g = 1.5f - 0.5f * (group->sin[l] * group->sin[l] + group->cos[l] * group->cos[l]);
+            group->sin[l] *= g;
+            group->cos[l] *= g;
+        }
+        if (group->ramping) //the chirped increment drifts as well
+        {
+            for (int l = 0; l < lanes; l++)
+            {
+                float g = 1.5f - 0.5f * (group->sinDelta[l] * group->sinDelta[l] + group->cosDelta[l] * group->cosDelta[l]);
+                group->sinDelta[l] *= g;
+                group->cosDelta[l] *= g;
+            }
+        }
+    }
+}
+
+void OscillatorBank::renderGroup(Group& group, int numSamples) noexcept
+{
+    //local copies => the compiler can keep them in registers while writing to the tile
+    alignas(32) float s[lanes], c[lanes], cd[lanes], sd[lanes], a[lanes];
+    std::copy(group.sin, group.sin + lanes, s);
+    std::copy(group.cos, group.cos + lanes, c);
+    std::copy(group.cosDelta, group.cosDelta + lanes, cd);
+    std::copy(group.sinDelta, group.sinDelta + lanes, sd);
+    std::copy(group.amplitude, group.amplitude + lanes, a);
+    for (int sample = 0; sample < numSamples; sample++)
+    {
+        float* sum = tile + sample * lanes;
+        for (int l = 0; l < lanes; l++)
+        {
+            float sl = s[l];
+            sum[l] += a[l] * sl;
+            s[l] = sl * cd[l] + c[l] * sd[l];
+            c[l] = c[l] * cd[l] - sl * sd[l];
+        }
+    }
+    std::copy(s, s + lanes, group.sin);
+    std::copy(c, c + lanes, group.cos);
+}
+
+void OscillatorBank::renderRampingGroup(Group& group, int numSamples) noexcept
+{
+    alignas(32) float s[lanes], c[lanes], cd[lanes], sd[lanes], a[lanes], as[lanes], qc[lanes], qs[lanes];
+    std::copy(group.sin, group.sin + lanes, s);
+    std::copy(group.cos, group.cos + lanes, c);
+    std::copy(group.cosDelta, group.cosDelta + lanes, cd);
+    std::copy(group.sinDelta, group.sinDelta + lanes, sd);
+    std::copy(group.amplitude, group.amplitude + lanes, a);
+    std::copy(group.amplitudeStep, group.amplitudeStep + lanes, as);
+    std::copy(group.cosChirp, group.cosChirp + lanes, qc);
+    std::copy(group.sinChirp, group.sinChirp + lanes, qs);
+    for (int sample = 0; sample < numSamples; sample++)
+    {
+        float* sum = tile + sample * lanes;
+        for (int l = 0; l < lanes; l++)
+        {
+            float sl = s[l];
+            float cdl = cd[l];
+            sum[l] += a[l] * sl;
+            a[l] += as[l];
+            s[l] = sl * cdl + c[l] * sd[l];
+            c[l] = c[l] * cdl - sl * sd[l];
+            cd[l] = cdl * qc[l] - sd[l] * qs[l];
+            sd[l] = sd[l] * qc[l] + cdl * qs[l];
+        }
+    }
+    std::copy(s, s + lanes, group.sin);
+    std::copy(c, c + lanes, group.cos);
+    std::copy(cd, cd + lanes, group.cosDelta);
+    std::copy(sd, sd + lanes, group.sinDelta);
+    std::copy(a, a + lanes, group.amplitude);
+}
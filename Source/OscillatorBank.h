@@ -0,0 +1,125 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/*  All sine partials of all voices in one struct of arrays.
+
+    Every oscillator is a rotating phasor (sin, cos): one sample is a 2x2
+    rotation by the phase increment, so there is no std::sin per sample. The
+    oscillators are grouped in blocks of 8 lanes, the fixed lane loops compile to
+    SSE/AVX/NEON. Each group runs through a tile of samples with its state in
+    registers, the lanes are only summed up once per sample at the end. Rounding
+    makes the phasor drift off the unit circle very slowly, so its length is
+    pulled back to 1 once per block.
+    Only groups with a non-zero amplitude are on the render list, the others keep
+    their phase.
+
+    Frequency and amplitude can ramp linearly over a number of samples: the
+    amplitude by a constant step, the frequency by rotating the phase increment
+    itself by a constant angle each sample (a chirp), so no trig runs per sample.
+*/
+class OscillatorBank
+{
+public:
+    static const int lanes = 8;
+
+    OscillatorBank() {}
+
+    //allocates, call before the audio starts
+    void setNumberOfOscillators(int newNumberOfOscillators)
+    {
+        numberOfOscillators = newNumberOfOscillators;
+        groups.assign((size_t)(numberOfOscillators + lanes - 1) / lanes, Group());
+        frequencies.assign((size_t)numberOfOscillators, 0.0f);
+        chirping.assign((size_t)numberOfOscillators, false);
+        renderList.reserve(groups.size());
+    }
+
+    int getNumberOfOscillators() const { return numberOfOscillators; }
+
+    void setSampleRate(float newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        std::fill(frequencies.begin(), frequencies.end(), -1.0f); //=> increments are recomputed
+    }
+
+    //the phase continues, so changing the frequency doesn't click
+    //rampSamples > 0 => frequency and amplitude are reached after rampSamples, render at most that many
+    //samples before the next call
+    void setOscillator(int index, float frequency, float amplitude, int rampSamples = 0) noexcept
+    {
+        Group& group = groups[(size_t)index / lanes];
+        const int lane = index % lanes;
+        group.amplitudeStep[lane] = rampSamples > 0 ? (amplitude - group.amplitude[lane]) / rampSamples : 0.0f;
+        if (rampSamples == 0)
+            group.amplitude[lane] = amplitude;
+
+        group.cosChirp[lane] = 1.0f;
+        group.sinChirp[lane] = 0.0f;
+        if (sampleRate <= 0.0f || (frequency == frequencies[index] && ! chirping[index]))
+            return;
+
+        if (rampSamples > 0 && frequency != frequencies[index])
+        {
+            double chirp = twoPi * (frequency - frequencies[index]) / sampleRate / rampSamples;
+            group.cosChirp[lane] = (float)std::cos(chirp);
+            group.sinChirp[lane] = (float)std::sin(chirp);
+            chirping[index] = true;
+        }
+        else //exact increment again after a chirp
+        {
+            double delta = twoPi * frequency / sampleRate;
+            group.cosDelta[lane] = (float)std::cos(delta);
+            group.sinDelta[lane] = (float)std::sin(delta);
+            chirping[index] = false;
+        }
+        frequencies[index] = frequency;
+    }
+
+    //adds the sum of all oscillators to output
+    void render(float* output, int numSamples) noexcept;
+
+private:
+    static constexpr int tileSamples = 64; //constexpr => inline, std::min() binds it by reference
+    static constexpr double twoPi = 2.0 * 3.14159265358979323846;
+
+    struct alignas(32) Group
+    {
+        float sin[lanes] = {};
+        float cos[lanes] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+        float cosDelta[lanes] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+        float sinDelta[lanes] = {};
+        float amplitude[lanes] = {};
+        float amplitudeStep[lanes] = {};
+        float cosChirp[lanes] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+        float sinChirp[lanes] = {};
+        bool ramping = false;
+    };
+
+    void renderGroup(Group& group, int numSamples) noexcept;
+
+    //same with the amplitude steps and the increments rotated by the chirp
+    void renderRampingGroup(Group& group, int numSamples) noexcept;
+
+    int numberOfOscillators = 0;
+    float sampleRate = 0.0f;
+    std::vector<Group> groups;
+    std::vector<float> frequencies;
+    std::vector<bool> chirping;
+    std::vector<Group*> renderList;
+    alignas(32) float tile[tileSamples * lanes];
+};
@@ -0,0 +1,35 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#include "Roughness.h"
+
+const Roughness::Kernel& Roughness::getKernel()
+{
+    static const Kernel kernel = chooseKernel();
+    return kernel;
+}
+
+std::vector<Roughness::Kernel> Roughness::getAvailableKernels()
+{
+    std::vector<Kernel> kernels { scalarKernel() };
+   #if ROUGHNESS_X86
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    kernels.push_back(vectorKernel<SseOps>());
+    #endif
+    if (cpuHasAvx2())
+        kernels.push_back(avxKernel());
+   #elif ROUGHNESS_NEON
+    kernels.push_back(vectorKernel<NeonOps>());
+   #endif
+    return kernels;
+}
@@ -0,0 +1,641 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+ #define ROUGHNESS_X86 1
+ #include <immintrin.h>
+ #if defined(_MSC_VER) && !defined(__clang__)
+  #include <intrin.h>
+  #define ROUGHNESS_TARGET_AVX2
+ #else
+  #define ROUGHNESS_TARGET_AVX2 __attribute__((target("avx2,fma")))
+ #endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+ #define ROUGHNESS_NEON 1
+ #include <arm_neon.h>
+#endif
+
+/*  Sethares' roughness model (Tuning, Timbre, Spectrum, Scale, p. 346) shared by
+    BackgroundVisualisation and DissonanceCurve.
+
+    Partials are passed as struct-of-arrays: one array of frequencies and one of
+    loudnesses (see loudness()). A partial with freq < 0 is inactive and is masked
+    out without branching. Each symmetric pair is evaluated once, the result is
+    scaled to match the sum over all ordered pairs (i != j).
+    The vector path (AVX2, SSE2 or NEON) is chosen once at runtime.
+
+    In fast mode the curve exp(-b1*x) - exp(-b2*x), x = s * f_dif, is read from an
+    interpolated lookup table instead (see FastCurve).
+
+    With critical band pruning, partials are sorted by frequency (skipped if they
+    already are) and each partial only meets the partials within a sliding window
+    of a few critical bandwidths (s1 * f + s2) above it, which makes the cost
+    close to linear in the number of partials.
+*/
+class Roughness
+{
+public:
+    static constexpr float x_star = 0.24f;
+    static constexpr float s1 = 0.0207f;
+    static constexpr float s2 = 18.96f;
+    static constexpr float b1 = 3.51f;
+    static constexpr float b2 = 5.75f;
+
+    //convert amplitude of a sine wave to loudness => Sethares (p. 346)
+    static float loudness(float amplitude)
+    {
+        float SPL = 2 * std::log10((amplitude / 1.41421356f) / 0.00002f);
+        return 0.0625f * std::pow(2.0f, SPL);
+    }
+
+    //dissonance of all partials with each other
+    static float dissmeasure(const float* freq, const float* loud, int numberOfPartials)
+    {
+        const Kernel& kernel = getKernel();
+        const bool fast = isFastMode();
+        const float bands = getCriticalBandwidths();
+        if (bands <= 0.0f)
+            return 2.0f * kernel.pairs[fast](freq, loud, numberOfPartials);
+
+        if (! std::is_sorted(freq, freq + numberOfPartials))
+        {
+            Scratch& scratch = getScratch();
+            scratch.sort(freq, loud, numberOfPartials);
+            freq = scratch.freq.data();
+            loud = scratch.loud.data();
+        }
+        return 2.0f * prunedPairs(kernel.row[fast], freq, loud, numberOfPartials, bands);
+    }
+
+    //dissonance between the partials of a and the partials of b (each pair counted once)
+    static float crossDissmeasure(const float* freqA, const float* loudA, int numberOfPartialsA,
+                                  const float* freqB, const float* loudB, int numberOfPartialsB)
+    {
+        const Kernel& kernel = getKernel();
+        const bool fast = isFastMode();
+        const float bands = getCriticalBandwidths();
+        if (bands <= 0.0f)
+            return kernel.cross[fast](freqA, loudA, numberOfPartialsA, freqB, loudB, numberOfPartialsB);
+
+        Scratch& scratch = getScratch();
+        if (! std::is_sorted(freqA, freqA + numberOfPartialsA))
+        {
+            scratch.sort(freqA, loudA, numberOfPartialsA);
+            freqA = scratch.freq.data();
+            loudA = scratch.loud.data();
+        }
+        if (! std::is_sorted(freqB, freqB + numberOfPartialsB))
+        {
+            scratch.sortB(freqB, loudB, numberOfPartialsB);
+            freqB = scratch.freqB.data();
+            loudB = scratch.loudB.data();
+        }
+        return prunedCross(kernel.row[fast], freqA, loudA, numberOfPartialsA, freqB, loudB, numberOfPartialsB, bands);
+    }
+
+    using RowFunction = float (*)(float, float, const float*, const float*, int, int);
+
+    //the loops of one instruction set, each pair counted once and without pruning (row: i against [begin, end) of b)
+    struct Kernel
+    {
+        const char* name;
+        float (*pairs[2])(const float*, const float*, int); //[exact, fast]
+        float (*cross[2])(const float*, const float*, int, const float*, const float*, int);
+        RowFunction row[2];
+    };
+
+    static const char* getKernelName() { return getKernel().name; }
+
+    //every kernel this CPU can run, the scalar one first => for the tests, which compare them against it
+    static std::vector<Kernel> getAvailableKernels();
+
+    //the settings can be changed from any thread, cached results have to be recomputed when getSettingsId() changes
+    static void setFastMode(bool shouldBeFast)
+    {
+        getSettings().fast.store(shouldBeFast, std::memory_order_relaxed);
+        getSettings().id++;
+    }
+
+    static bool isFastMode() { return getSettings().fast.load(std::memory_order_relaxed); }
+
+    //pairs further apart than this many critical bandwidths are skipped, 0 => all pairs are evaluated
+    static void setCriticalBandwidths(float numberOfBandwidths)
+    {
+        getSettings().bands.store(std::max(0.0f, numberOfBandwidths), std::memory_order_relaxed);
+        getSettings().id++;
+    }
+
+    static float getCriticalBandwidths() { return getSettings().bands.load(std::memory_order_relaxed); }
+
+    static int getSettingsId() { return getSettings().id.load(); }
+
+    //exact roughness of a single pair of partials
+    static float pairDissonance(float f_i, float l_i, float f_j, float l_j) { return pairTerm<false>(f_i, l_i, f_j, l_j); }
+
+    /*  exp(-b1*x) - exp(-b2*x) sampled at size + 1 points over [0, maxX] and linearly
+        interpolated. Above maxX the curve is below 1e-6 and taken as 0.
+        Max absolute error against the exact curve: 1.0e-5 (the curve peaks at 0.18),
+        dominated by the interpolation error near x = 0.
+    */
+    struct FastCurve
+    {
+        static constexpr int size = 2048;
+        static constexpr float maxX = 4.0f;
+        static constexpr float scale = size / maxX;
+
+        FastCurve()
+        {
+            for (int i = 0; i < size; i++)
+            {
+                double x = i / (double)scale;
+                table[i] = (float)(std::exp(-b1 * x) - std::exp(-b2 * x));
+            }
+            table[size] = table[size + 1] = 0.0f;
+        }
+
+        float operator()(float x) const
+        {
+            float position = std::min(x * scale, (float)size);
+            int i = (int)position;
+            float frac = position - (float)i;
+            return table[i] + frac * (table[i + 1] - table[i]);
+        }
+
+        alignas(64) float table[size + 2];
+    };
+
+    static const FastCurve& getFastCurve()
+    {
+        static const FastCurve curve;
+        return curve;
+    }
+
+private:
+    struct Settings
+    {
+        std::atomic<bool> fast { false };
+        std::atomic<float> bands { 16.0f }; //=> x = s * f_dif <= 3.84, where the curve is below 1.5e-6
+        std::atomic<int> id { 0 };
+    };
+
+    static Settings& getSettings()
+    {
+        static Settings settings;
+        return settings;
+    }
+
+    //sorted copies of unsorted input, one per thread => only allocates when it has to grow
+    struct Scratch
+    {
+        std::vector<int> order;
+        std::vector<float> freq, loud, freqB, loudB;
+
+        void sort(const float* f, const float* l, int n) { sortInto(f, l, n, freq, loud); }
+        void sortB(const float* f, const float* l, int n) { sortInto(f, l, n, freqB, loudB); }
+
+        void sortInto(const float* f, const float* l, int n, std::vector<float>& sortedFreq, std::vector<float>& sortedLoud)
+        {
+            order.resize((size_t)n);
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [f](int a, int b) { return f[a] < f[b]; });
+            sortedFreq.resize((size_t)n);
+            sortedLoud.resize((size_t)n);
+            for (int i = 0; i < n; i++)
+            {
+                sortedFreq[i] = f[order[i]];
+                sortedLoud[i] = l[order[i]];
+            }
+        }
+    };
+
+    static Scratch& getScratch()
+    {
+        static thread_local Scratch scratch;
+        return scratch;
+    }
+
+    //freq sorted ascending => inactive partials (freq < 0) come first and are skipped
+    static float prunedPairs(RowFunction row, const float* freq, const float* loud, int n, float bands)
+    {
+        float d = 0.0f;
+        int i = (int)(std::lower_bound(freq, freq + n, 0.0f) - freq);
+        int end = i;
+        for (; i < n; i++)
+        {
+            float upper = freq[i] + bands * (s1 * freq[i] + s2);
+            while (end < n && freq[end] <= upper)
+                end++;
+            d += row(freq[i], loud[i], freq, loud, i + 1, end);
+        }
+        return d;
+    }
+
+    static float prunedCross(RowFunction row, const float* fa, const float* la, int na,
+                             const float* fb, const float* lb, int nb, float bands)
+    {
+        float d = 0.0f;
+        int begin = (int)(std::lower_bound(fb, fb + nb, 0.0f) - fb);
+        int end = begin;
+        for (int i = (int)(std::lower_bound(fa, fa + na, 0.0f) - fa); i < na; i++)
+        {
+            float lower = (fa[i] - bands * s2) / (1.0f + bands * s1); //f_a - f_b <= bands * (s1 * f_b + s2)
+            float upper = fa[i] + bands * (s1 * fa[i] + s2);
+            while (begin < nb && fb[begin] < lower)
+                begin++;
+            end = std::max(end, begin);
+            while (end < nb && fb[end] <= upper)
+                end++;
+            d += row(fa[i], la[i], fb, lb, begin, end);
+        }
+        return d;
+    }
+
+    template <bool fast>
+    static float pairTerm(float f_i, float l_i, float f_j, float l_j)
+    {
+        float mask = (f_i >= 0.0f && f_j >= 0.0f) ? 1.0f : 0.0f;
+        float l_ij = mask * std::min(l_i, l_j);
+        float s = x_star / (s1 * std::max(std::min(f_i, f_j), 0.0f) + s2);
+        float x = s * std::abs(f_i - f_j);
+        if (fast)
+            return l_ij * getFastCurve()(x);
+        return l_ij * (std::exp(-b1 * x) - std::exp(-b2 * x));
+    }
+
+    //========================================================================== scalar
+    struct ScalarOps
+    {
+        static const char* name() { return "scalar"; }
+        template <bool fast>
+        static float pairs(const float* freq, const float* loud, int n)
+        {
+            float d = 0.0f;
+            for (int i = 0; i < n; i++)
+                for (int j = i + 1; j < n; j++)
+                    d += pairTerm<fast>(freq[i], loud[i], freq[j], loud[j]);
+            return d;
+        }
+        template <bool fast>
+        static float cross(const float* fa, const float* la, int na, const float* fb, const float* lb, int nb)
+        {
+            float d = 0.0f;
+            for (int i = 0; i < na; i++)
+                for (int j = 0; j < nb; j++)
+                    d += pairTerm<fast>(fa[i], la[i], fb[j], lb[j]);
+            return d;
+        }
+        template <bool fast>
+        static float row(float f_i, float l_i, const float* fb, const float* lb, int begin, int end)
+        {
+            float d = 0.0f;
+            for (int j = begin; j < end; j++)
+                d += pairTerm<fast>(f_i, l_i, fb[j], lb[j]);
+            return d;
+        }
+    };
+
+    //one row: partial i against partials [begin, end) of b
+    template <typename Ops, bool fast>
+    static inline float row(float f_i, float l_i, const float* fb, const float* lb, int begin, int end)
+    {
+        typename Ops::V fi = Ops::set1(f_i);
+        typename Ops::V li = Ops::set1(l_i);
+        typename Ops::V acc = Ops::set1(0.0f);
+        int j = begin;
+        for (; j + Ops::width <= end; j += Ops::width)
+            acc = Ops::add(acc, Ops::template term<fast>(fi, li, Ops::load(fb + j), Ops::load(lb + j)));
+
+        float d = Ops::sum(acc);
+        for (; j < end; j++)
+            d += pairTerm<fast>(f_i, l_i, fb[j], lb[j]);
+        return d;
+    }
+
+#if ROUGHNESS_X86
+    //========================================================================== SSE2
+    struct SseOps
+    {
+        using V = __m128;
+        static constexpr int width = 4;
+        static V set1(float x) { return _mm_set1_ps(x); }
+        static V load(const float* p) { return _mm_loadu_ps(p); }
+        static V add(V a, V b) { return _mm_add_ps(a, b); }
+        static float sum(V a)
+        {
+            alignas(16) float t[4];
+            _mm_store_ps(t, a);
+            return (t[0] + t[1]) + (t[2] + t[3]);
+        }
+
+        //Cephes style expf, valid for the non-positive arguments used here
+        static V exp(V x)
+        {
+            x = _mm_max_ps(x, _mm_set1_ps(-87.0f));
+            V fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504f)), _mm_set1_ps(0.5f));
+            V t = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+            V n = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, fx), _mm_set1_ps(1.0f))); //floor
+            x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(0.693359375f)));
+            x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(-2.12194440e-4f)));
+            V y = _mm_set1_ps(1.9875691500e-4f);
+            y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+            y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+            y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+            y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+            y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+            y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)), x), _mm_set1_ps(1.0f));
+            __m128i e = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23);
+            return _mm_mul_ps(y, _mm_castsi128_ps(e));
+        }
+
+        static V lookup(V x)
+        {
+            const float* table = getFastCurve().table;
+            V position = _mm_min_ps(_mm_mul_ps(x, _mm_set1_ps(FastCurve::scale)), _mm_set1_ps((float)FastCurve::size));
+            __m128i index = _mm_cvttps_epi32(position);
+            V frac = _mm_sub_ps(position, _mm_cvtepi32_ps(index));
+            alignas(16) int i[4];
+            _mm_store_si128((__m128i*)i, index);
+            V y0 = _mm_setr_ps(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+            V y1 = _mm_setr_ps(table[i[0] + 1], table[i[1] + 1], table[i[2] + 1], table[i[3] + 1]);
+            return _mm_add_ps(y0, _mm_mul_ps(frac, _mm_sub_ps(y1, y0)));
+        }
+
+        template <bool fast>
+        static V term(V fi, V li, V fj, V lj)
+        {
+            const V zero = _mm_setzero_ps();
+            V active = _mm_and_ps(_mm_cmpge_ps(fi, zero), _mm_cmpge_ps(fj, zero));
+            V l_ij = _mm_and_ps(active, _mm_min_ps(li, lj));
+            V fmin = _mm_max_ps(_mm_min_ps(fi, fj), zero);
+            V s = _mm_div_ps(_mm_set1_ps(x_star), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(s1), fmin), _mm_set1_ps(s2)));
+            V f_dif = _mm_andnot_ps(_mm_set1_ps(-0.0f), _mm_sub_ps(fi, fj));
+            V x = _mm_mul_ps(s, f_dif);
+            if (fast)
+                return _mm_mul_ps(l_ij, lookup(x));
+            V e = _mm_sub_ps(exp(_mm_mul_ps(_mm_set1_ps(-b1), x)), exp(_mm_mul_ps(_mm_set1_ps(-b2), x)));
+            return _mm_mul_ps(l_ij, e);
+        }
+
+        static const char* name() { return "sse2"; }
+    };
+
+    //========================================================================== AVX2
+    struct AvxOps
+    {
+        using V = __m256;
+        static constexpr int width = 8;
+        ROUGHNESS_TARGET_AVX2 static float sum(V a)
+        {
+            __m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+            alignas(16) float t[4];
+            _mm_store_ps(t, s);
+            return (t[0] + t[1]) + (t[2] + t[3]);
+        }
+
+        ROUGHNESS_TARGET_AVX2 static V exp(V x)
+        {
+            x = _mm256_max_ps(x, _mm256_set1_ps(-87.0f));
+            V n = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(1.44269504f), _mm256_set1_ps(0.5f)));
+            x = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+            x = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), x);
+            V y = _mm256_set1_ps(1.9875691500e-4f);
+            y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507e-3f));
+            y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073e-3f));
+            y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894e-2f));
+            y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459e-1f));
+            y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201e-1f));
+            y = _mm256_add_ps(_mm256_fmadd_ps(y, _mm256_mul_ps(x, x), x), _mm256_set1_ps(1.0f));
+            __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(n), _mm256_set1_epi32(127)), 23);
+            return _mm256_mul_ps(y, _mm256_castsi256_ps(e));
+        }
+
+        ROUGHNESS_TARGET_AVX2 static V lookup(V x)
+        {
+            const float* table = getFastCurve().table;
+            V position = _mm256_min_ps(_mm256_mul_ps(x, _mm256_set1_ps(FastCurve::scale)), _mm256_set1_ps((float)FastCurve::size));
+            __m256i index = _mm256_cvttps_epi32(position);
+            V frac = _mm256_sub_ps(position, _mm256_cvtepi32_ps(index));
+            V y0 = _mm256_i32gather_ps(table, index, 4);
+            V y1 = _mm256_i32gather_ps(table + 1, index, 4);
+            return _mm256_fmadd_ps(frac, _mm256_sub_ps(y1, y0), y0);
+        }
+
+        template <bool fast>
+        ROUGHNESS_TARGET_AVX2 static V term(V fi, V li, V fj, V lj)
+        {
+            const V zero = _mm256_setzero_ps();
+            V active = _mm256_and_ps(_mm256_cmp_ps(fi, zero, _CMP_GE_OQ), _mm256_cmp_ps(fj, zero, _CMP_GE_OQ));
+            V l_ij = _mm256_and_ps(active, _mm256_min_ps(li, lj));
+            V fmin = _mm256_max_ps(_mm256_min_ps(fi, fj), zero);
+            V s = _mm256_div_ps(_mm256_set1_ps(x_star), _mm256_fmadd_ps(_mm256_set1_ps(s1), fmin, _mm256_set1_ps(s2)));
+            V f_dif = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_sub_ps(fi, fj));
+            V x = _mm256_mul_ps(s, f_dif);
+            if (fast)
+                return _mm256_mul_ps(l_ij, lookup(x));
+            V e = _mm256_sub_ps(exp(_mm256_mul_ps(_mm256_set1_ps(-b1), x)), exp(_mm256_mul_ps(_mm256_set1_ps(-b2), x)));
+            return _mm256_mul_ps(l_ij, e);
+        }
+
+        static const char* name() { return "avx2"; }
+    };
+
+    //same as row<Ops>, but compiled for AVX2 so the ops above can be inlined
+    template <bool fast>
+    ROUGHNESS_TARGET_AVX2 static float avxRow(float f_i, float l_i, const float* fb, const float* lb, int begin, int end)
+    {
+        __m256 fi = _mm256_set1_ps(f_i);
+        __m256 li = _mm256_set1_ps(l_i);
+        __m256 acc = _mm256_setzero_ps();
+        int j = begin;
+        for (; j + AvxOps::width <= end; j += AvxOps::width)
+            acc = _mm256_add_ps(acc, AvxOps::term<fast>(fi, li, _mm256_loadu_ps(fb + j), _mm256_loadu_ps(lb + j)));
+
+        float d = AvxOps::sum(acc);
+        for (; j < end; j++)
+            d += pairTerm<fast>(f_i, l_i, fb[j], lb[j]);
+        return d;
+    }
+
+    template <bool fast>
+    ROUGHNESS_TARGET_AVX2 static float avxPairs(const float* freq, const float* loud, int n)
+    {
+        float d = 0.0f;
+        for (int i = 0; i < n; i++)
+            d += avxRow<fast>(freq[i], loud[i], freq, loud, i + 1, n);
+        return d;
+    }
+
+    template <bool fast>
+    ROUGHNESS_TARGET_AVX2 static float avxCross(const float* fa, const float* la, int na, const float* fb, const float* lb, int nb)
+    {
+        float d = 0.0f;
+        for (int i = 0; i < na; i++)
+            d += avxRow<fast>(fa[i], la[i], fb, lb, 0, nb);
+        return d;
+    }
+
+    static Kernel avxKernel()
+    {
+        return { AvxOps::name(), { &avxPairs<false>, &avxPairs<true> }, { &avxCross<false>, &avxCross<true> },
+                                 { &avxRow<false>, &avxRow<true> } };
+    }
+
+    static bool cpuHasAvx2()
+    {
+       #if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0, fma = (info[2] & (1 << 12)) != 0;
+        __cpuidex(info, 7, 0);
+        return osxsave && fma && (info[1] & (1 << 5)) != 0 && (_xgetbv(0) & 6) == 6;
+       #else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+       #endif
+    }
+#endif
+
+#if ROUGHNESS_NEON
+    //========================================================================== NEON
+    struct NeonOps
+    {
+        using V = float32x4_t;
+        static constexpr int width = 4;
+        static V set1(float x) { return vdupq_n_f32(x); }
+        static V load(const float* p) { return vld1q_f32(p); }
+        static V add(V a, V b) { return vaddq_f32(a, b); }
+        static float sum(V a)
+        {
+            float32x2_t s = vadd_f32(vget_low_f32(a), vget_high_f32(a));
+            return vget_lane_f32(vpadd_f32(s, s), 0);
+        }
+
+        static V exp(V x)
+        {
+            x = vmaxq_f32(x, vdupq_n_f32(-87.0f));
+            V fx = vmlaq_f32(vdupq_n_f32(0.5f), x, vdupq_n_f32(1.44269504f));
+            V t = vcvtq_f32_s32(vcvtq_s32_f32(fx));
+            uint32x4_t gt = vcgtq_f32(t, fx);
+            V n = vsubq_f32(t, vreinterpretq_f32_u32(vandq_u32(gt, vreinterpretq_u32_f32(vdupq_n_f32(1.0f)))));
+            x = vmlsq_f32(x, n, vdupq_n_f32(0.693359375f));
+            x = vmlsq_f32(x, n, vdupq_n_f32(-2.12194440e-4f));
+            V y = vdupq_n_f32(1.9875691500e-4f);
+            y = vmlaq_f32(vdupq_n_f32(1.3981999507e-3f), y, x);
+            y = vmlaq_f32(vdupq_n_f32(8.3334519073e-3f), y, x);
+            y = vmlaq_f32(vdupq_n_f32(4.1665795894e-2f), y, x);
+            y = vmlaq_f32(vdupq_n_f32(1.6666665459e-1f), y, x);
+            y = vmlaq_f32(vdupq_n_f32(5.0000001201e-1f), y, x);
+            y = vaddq_f32(vmlaq_f32(x, y, vmulq_f32(x, x)), vdupq_n_f32(1.0f));
+            int32x4_t e = vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23);
+            return vmulq_f32(y, vreinterpretq_f32_s32(e));
+        }
+
+        static V lookup(V x)
+        {
+            const float* table = getFastCurve().table;
+            V position = vminq_f32(vmulq_f32(x, vdupq_n_f32(FastCurve::scale)), vdupq_n_f32((float)FastCurve::size));
+            int32x4_t index = vcvtq_s32_f32(position);
+            V frac = vsubq_f32(position, vcvtq_f32_s32(index));
+            int i[4];
+            vst1q_s32(i, index);
+            float y0[4] = { table[i[0]], table[i[1]], table[i[2]], table[i[3]] };
+            float y1[4] = { table[i[0] + 1], table[i[1] + 1], table[i[2] + 1], table[i[3] + 1] };
+            V a = vld1q_f32(y0);
+            return vmlaq_f32(a, frac, vsubq_f32(vld1q_f32(y1), a));
+        }
+
+        template <bool fast>
+        static V term(V fi, V li, V fj, V lj)
+        {
+            const V zero = vdupq_n_f32(0.0f);
+            uint32x4_t active = vandq_u32(vcgeq_f32(fi, zero), vcgeq_f32(fj, zero));
+            V l_ij = vreinterpretq_f32_u32(vandq_u32(active, vreinterpretq_u32_f32(vminq_f32(li, lj))));
+            V fmin = vmaxq_f32(vminq_f32(fi, fj), zero);
+            V denom = vmlaq_f32(vdupq_n_f32(s2), fmin, vdupq_n_f32(s1));
+            V r = vrecpeq_f32(denom);
+            r = vmulq_f32(r, vrecpsq_f32(denom, r));
+            r = vmulq_f32(r, vrecpsq_f32(denom, r));
+            V x = vmulq_f32(vmulq_f32(vdupq_n_f32(x_star), r), vabdq_f32(fi, fj));
+            if (fast)
+                return vmulq_f32(l_ij, lookup(x));
+            V e = vsubq_f32(exp(vmulq_f32(vdupq_n_f32(-b1), x)), exp(vmulq_f32(vdupq_n_f32(-b2), x)));
+            return vmulq_f32(l_ij, e);
+        }
+
+        static const char* name() { return "neon"; }
+    };
+#endif
+
+    template <typename Ops, bool fast>
+    static float vectorPairs(const float* freq, const float* loud, int n)
+    {
+        float d = 0.0f;
+        for (int i = 0; i < n; i++)
+            d += row<Ops, fast>(freq[i], loud[i], freq, loud, i + 1, n);
+        return d;
+    }
+
+    template <typename Ops, bool fast>
+    static float vectorCross(const float* fa, const float* la, int na, const float* fb, const float* lb, int nb)
+    {
+        float d = 0.0f;
+        for (int i = 0; i < na; i++)
+            d += row<Ops, fast>(fa[i], la[i], fb, lb, 0, nb);
+        return d;
+    }
+
+    template <typename Ops>
+    static Kernel vectorKernel()
+    {
+        return { Ops::name(), { &vectorPairs<Ops, false>, &vectorPairs<Ops, true> },
+                              { &vectorCross<Ops, false>, &vectorCross<Ops, true> },
+                              { &row<Ops, false>, &row<Ops, true> } };
+    }
+
+    static Kernel chooseKernel()
+    {
+       #if ROUGHNESS_X86
+        if (cpuHasAvx2())
+            return avxKernel();
+        #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        return vectorKernel<SseOps>();
+        #else
+        return scalarKernel();
+        #endif
+       #elif ROUGHNESS_NEON
+        return vectorKernel<NeonOps>();
+       #else
+        return scalarKernel();
+       #endif
+    }
+
+    static Kernel scalarKernel()
+    {
+        return { ScalarOps::name(), { &ScalarOps::pairs<false>, &ScalarOps::pairs<true> },
+                                    { &ScalarOps::cross<false>, &ScalarOps::cross<true> },
+                                    { &ScalarOps::row<false>, &ScalarOps::row<true> } };
+    }
+
+    //in Roughness.cpp => all kernels are compiled there, with the core library's optimisation flags
+    static const Kernel& getKernel();
+};
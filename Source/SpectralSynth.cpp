@@ -0,0 +1,102 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#include "SpectralSynth.h"
+
+void SpectralSynth::render(float* output, int numSamples) noexcept
+{
+    if (sampleRate <= 0.0f)
+        return;
+
+    while (numSamples > 0)
+    {
+        if (position == hopSize)
+            nextFrame();
+
+        int n = std::min(numSamples, hopSize - position);
+        for (int i = 0; i < n; i++)
+            output[i] += overlap[position + i];
+        output += n;
+        numSamples -= n;
+        position += n;
+    }
+}
+
+void SpectralSynth::nextFrame() noexcept
+{
+    //the first hop has been played, the rest moves to the front for the next frame
+    std::copy(overlap.begin() + hopSize, overlap.end(), overlap.begin());
+    std::fill(overlap.end() - hopSize, overlap.end(), 0.0f);
+    position = 0;
+
+    std::fill(spectrum.begin(), spectrum.end(), Complex());
+    const float binsPerHz = frameSize / sampleRate;
+    for (int j = 0; j < numberOfOscillators; j++)
+    {
+        float bin = frequencies[j] * binsPerHz;
+        if (amplitudes[j] != 0.0f && bin >= 0.0f && bin < frameSize / 2 - kernelBins - 1)
+            addPartial(bin, amplitudes[j] * phasors[j]);
+
+        //phase of the next frame, pulled back onto the unit circle like in OscillatorBank
+        Complex p = multiply(phasors[j], rotations[j]);
+        phasors[j] = p * (1.5f - 0.5f * std::norm(p));
+    }
+
+    inverseFft();
+    for (int n = 0; n < frameSize; n++)
+        overlap[n] += spectrum[n].real() * (1.0f / frameSize);
+}
+
+void SpectralSynth::addPartial(float bin, Complex amplitude) noexcept
+{
+    const int base = (int)bin;
+    const float x = (bin - base) * kernelResolution;
+    const int row = (int)x;
+    const Complex* a = &kernelTable[(size_t)row * kernelWidth];
+    const Complex* b = a + kernelWidth;
+    const Complex fracA = amplitude * (1.0f - (x - row));
+    const Complex fracB = amplitude * (x - row);
+
+    const int first = base - kernelBins;
+    if (first < 0) //wraps around to the negative frequencies
+    {
+        for (int i = 0; i < kernelWidth; i++)
+            spectrum[(size_t)((first + i) & (frameSize - 1))] += multiply(fracA, a[i]) + multiply(fracB, b[i]);
+        return;
+    }
+    Complex* s = &spectrum[(size_t)first];
+    for (int i = 0; i < kernelWidth; i++)
+        s[i] += multiply(fracA, a[i]) + multiply(fracB, b[i]);
+}
+
+void SpectralSynth::inverseFft() noexcept
+{
+    for (int i = 0; i < frameSize; i++)
+        if (i < bitReversed[i])
+            std::swap(spectrum[i], spectrum[bitReversed[i]]);
+
+    for (int length = 2; length <= frameSize; length *= 2)
+    {
+        const int half = length / 2;
+        const int stride = frameSize / length;
+        for (int start = 0; start < frameSize; start += length)
+        {
+            for (int k = 0; k < half; k++)
+            {
+                Complex t = multiply(twiddles[(size_t)k * stride], spectrum[start + k + half]);
+                spectrum[start + k + half] = spectrum[start + k] - t;
+                spectrum[start + k] += t;
+            }
+        }
+    }
+}
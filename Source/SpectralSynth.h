@@ -0,0 +1,158 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+/*  Additive synthesis by inverse FFT and overlap-add, same interface as
+    OscillatorBank.
+
+    Every frame of frameSize samples is a windowed sum of sinusoids. The window
+    is a squared Hann window, whose spectrum falls off fast enough that each
+    partial only adds kernelWidth precomputed bins around its frequency to the
+    frame's spectrum (about -90 dB error), then one inverse FFT gives the whole
+    frame. Frames overlap by three quarters, where the windows add up to 1.5.
+    The cost is per frame and per partial, not per sample and partial, so
+    hundreds of partials per voice stay cheap.
+    Frequencies and amplitudes are picked up once per hop (hopSize samples) and
+    glide over the overlap, the phase of every partial continues from frame to
+    frame.
+*/
+class SpectralSynth
+{
+public:
+    static const int frameSize = 1024;
+    static const int hopSize = frameSize / 4;
+    static const int kernelBins = 6; //bins on either side of a partial
+
+    SpectralSynth()
+    {
+        prepareFft();
+        prepareKernel();
+        spectrum.resize((size_t)frameSize);
+        overlap.assign((size_t)frameSize, 0.0f);
+    }
+
+    //allocates, call before the audio starts
+    void setNumberOfOscillators(int newNumberOfOscillators)
+    {
+        numberOfOscillators = newNumberOfOscillators;
+        frequencies.assign((size_t)numberOfOscillators, 0.0f);
+        amplitudes.assign((size_t)numberOfOscillators, 0.0f);
+        phasors.assign((size_t)numberOfOscillators, Complex(1.0f, 0.0f));
+        rotations.assign((size_t)numberOfOscillators, Complex(1.0f, 0.0f));
+    }
+
+    int getNumberOfOscillators() const { return numberOfOscillators; }
+
+    void setSampleRate(float newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        std::fill(frequencies.begin(), frequencies.end(), -1.0f); //=> rotations are recomputed
+        std::fill(overlap.begin(), overlap.end(), 0.0f);
+        position = hopSize; //=> the first render starts a new frame
+    }
+
+    void setOscillator(int index, float frequency, float amplitude) noexcept
+    {
+        amplitudes[index] = amplitude;
+        if (frequency != frequencies[index] && sampleRate > 0.0f)
+        {
+            frequencies[index] = frequency;
+            rotations[index] = std::polar(1.0f, (float)std::fmod(2.0 * pi * hopSize * frequency / sampleRate, 2.0 * pi));
+        }
+    }
+
+    //adds the sum of all oscillators to output
+    void render(float* output, int numSamples) noexcept;
+
+private:
+    using Complex = std::complex<float>;
+    static const int kernelResolution = 256; //table rows per bin
+    static const int kernelWidth = 2 * kernelBins + 2;
+
+    void nextFrame() noexcept;
+
+    //adds the window spectrum shifted to bin, the mirror image at -bin is left out,
+    //taking the real part of the inverse FFT adds it back
+    void addPartial(float bin, Complex amplitude) noexcept;
+
+    //without the inf/nan special cases of operator*, which aren't inlined
+    static Complex multiply(Complex a, Complex b) noexcept
+    {
+        return { a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real() };
+    }
+
+    //H(m) = sum over n of w(n) * e^(-j 2 pi m n / N), w = (0.5 - 0.5 cos(2 pi n / N))^2 / 1.5
+    //row r holds the kernelWidth bins around a partial r / kernelResolution above a bin
+    void prepareKernel()
+    {
+        auto dirichlet = [](double m)
+        {
+            const double N = frameSize;
+            double magnitude = std::abs(m) < 1.0e-9 ? N : std::sin(pi * m) / std::sin(pi * m / N);
+            return std::polar(magnitude, -pi * m * (N - 1.0) / N);
+        };
+
+        kernelTable.resize((size_t)(kernelResolution + 1) * kernelWidth);
+        for (int r = 0; r <= kernelResolution; r++)
+        {
+            for (int i = 0; i < kernelWidth; i++)
+            {
+                double m = i - kernelBins - (double)r / kernelResolution;
+                kernelTable[(size_t)r * kernelWidth + i] = Complex((0.375 * dirichlet(m) - 0.25 * (dirichlet(m - 1.0) + dirichlet(m + 1.0))
+                                                                    + 0.0625 * (dirichlet(m - 2.0) + dirichlet(m + 2.0))) / 1.5);
+            }
+        }
+    }
+
+    void prepareFft()
+    {
+        twiddles.resize((size_t)frameSize / 2);
+        for (int i = 0; i < frameSize / 2; i++)
+            twiddles[i] = std::polar(1.0f, (float)(2.0 * pi * i / frameSize)); //inverse => positive exponent
+
+        bitReversed.resize((size_t)frameSize);
+        int bits = 0;
+        while ((1 << bits) < frameSize)
+            bits++;
+        for (int i = 0; i < frameSize; i++)
+        {
+            int r = 0;
+            for (int b = 0; b < bits; b++)
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+            bitReversed[i] = r;
+        }
+    }
+
+    //in place radix 2, without the 1 / N
+    void inverseFft() noexcept;
+
+    static constexpr double pi = 3.14159265358979323846;
+
+    int numberOfOscillators = 0;
+    float sampleRate = 0.0f;
+    int position = hopSize;
+    std::vector<float> frequencies;
+    std::vector<float> amplitudes;
+    std::vector<Complex> phasors;
+    std::vector<Complex> rotations;
+    std::vector<Complex> spectrum;
+    std::vector<float> overlap;
+    std::vector<Complex> kernelTable;
+    std::vector<Complex> twiddles;
+    std::vector<int> bitReversed;
+};
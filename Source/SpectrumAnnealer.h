@@ -0,0 +1,258 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+#include "Roughness.h"
+#include "WorkerPool.h"
+
+/*  Simulated annealing of a spectrum for an equal temperament: partial ratios
+    and amplitudes are moved until the scale steps 2^(k / notesPerOctave) are
+    dips of the dissonance curve (Sethares, Tuning, Timbre, Spectrum, Scale,
+    ch. 10, does this with a gradient method).
+
+        cost = mean cross dissonance of the spectrum with itself at the steps
+             / mean cross dissonance halfway between the steps
+
+    The cost doesn't change when all amplitudes are scaled. Amplitudes stay
+    within [0.5, 1.5] times their start, so no partial can vanish, every ratio
+    stays between its neighbours, so the partials stay sorted for the pruned
+    Roughness kernel, and the fundamental doesn't move.
+
+    Every worker of the pool runs its own chain with its own random numbers,
+    a move only recomputes the terms of the partial it changed. After each
+    round all chains go on from the best spectrum so far and the temperature
+    drops, until it's below stopTemperature of the start.
+*/
+class SpectrumAnnealer
+{
+public:
+    static constexpr float cooling = 0.85f;
+    static constexpr float stopTemperature = 1.0e-3f;
+    static const int evaluationsPerRound = 24000; //per chain, one evaluation = one partial at one shift
+
+    //chains run on the pool, nullptr => one chain on the calling thread
+    void setWorkerPool(WorkerPool* newPool) { pool = newPool; }
+
+    //starts over from the given spectrum (any order)
+    void start(float root, int notesPerOctave, const float* ratios, const float* amplitudes, int newNumberOfPartials, unsigned int seed = 1)
+    {
+        numberOfPartials = std::max(0, newNumberOfPartials);
+        numberOfSteps = std::max(2, notesPerOctave);
+        shifts.clear();
+        for (int k = 1; k < numberOfSteps; k++)
+            shifts.push_back(std::pow(2.0f, (float)k / numberOfSteps));
+        for (int k = 0; k < numberOfSteps; k++)
+            shifts.push_back(std::pow(2.0f, (k + 0.5f) / numberOfSteps));
+
+        std::vector<int> order((size_t)numberOfPartials);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return ratios[a] < ratios[b]; });
+        bestRatios.resize((size_t)numberOfPartials);
+        bestAmplitudes.resize((size_t)numberOfPartials);
+        startAmplitudes.resize((size_t)numberOfPartials);
+        for (int i = 0; i < numberOfPartials; i++)
+        {
+            bestRatios[i] = ratios[order[i]];
+            bestAmplitudes[i] = startAmplitudes[i] = amplitudes[order[i]];
+        }
+
+        chains.resize((size_t)(pool != nullptr ? pool->getNumberOfWorkers() : 1));
+        for (size_t c = 0; c < chains.size(); c++)
+        {
+            Chain& chain = chains[c];
+            chain.random.seed(seed + 7919u * (unsigned int)c);
+            chain.ratios.resize((size_t)numberOfPartials); //sized here => loadBest() doesn't allocate on the workers
+            chain.amplitudes.resize((size_t)numberOfPartials);
+            chain.frequencies.resize((size_t)numberOfPartials);
+            chain.loudness.resize((size_t)numberOfPartials);
+            chain.shifted.resize((size_t)numberOfPartials);
+            chain.terms.resize(shifts.size());
+            chain.newTerms.resize(shifts.size());
+            chain.rootFrequency = root;
+        }
+        loadBest(chains[0]);
+        bestCost = startCost = chains[0].cost;
+        startTemperature = temperature = 0.02f * startCost;
+        rounds = 0;
+    }
+
+    //every chain makes a round of moves, returns false once cooled down or when shouldStop() returned true
+    template <typename ShouldStop>
+    bool round(ShouldStop&& shouldStop)
+    {
+        //startTemperature 0 => a silent start spectrum, nothing to optimise and no scale for the moves
+        if (numberOfPartials < 2 || startTemperature <= 0.0f || temperature < stopTemperature * startTemperature || shouldStop())
+            return false;
+
+        auto body = [&](int begin, int end, int)
+        {
+            for (int c = begin; c < end; c++)
+            {
+                loadBest(chains[(size_t)c]);
+                anneal(chains[(size_t)c], shouldStop);
+            }
+        };
+        if (pool != nullptr)
+            pool->parallelFor((int)chains.size(), 1, body);
+        else
+            body(0, (int)chains.size(), 0);
+
+        for (const Chain& chain : chains)
+        {
+            if (chain.cost < bestCost)
+            {
+                bestCost = chain.cost;
+                bestRatios = chain.ratios;
+                bestAmplitudes = chain.amplitudes;
+            }
+        }
+        temperature *= cooling;
+        rounds++;
+        return ! shouldStop();
+    }
+
+    //the best spectrum so far, sorted by ratio
+    const std::vector<float>& getRatios() const { return bestRatios; }
+    const std::vector<float>& getAmplitudes() const { return bestAmplitudes; }
+    float getCost() const { return bestCost; }
+    float getStartCost() const { return startCost; }
+    int getRounds() const { return rounds; }
+
+private:
+    struct Chain
+    {
+        std::vector<float> ratios;
+        std::vector<float> amplitudes;
+        std::vector<float> frequencies;
+        std::vector<float> loudness;
+        std::vector<float> shifted;
+        std::vector<float> terms; //cross dissonance at each shift: the steps, then the midpoints
+        std::vector<float> newTerms;
+        float rootFrequency = 0.0f;
+        float cost = 0.0f;
+        std::mt19937 random;
+    };
+
+    //the chain starts from the best spectrum, all terms recomputed => no drift from the incremental updates
+    void loadBest(Chain& chain) const
+    {
+        chain.ratios = bestRatios;
+        chain.amplitudes = bestAmplitudes;
+        for (int i = 0; i < numberOfPartials; i++)
+        {
+            chain.frequencies[i] = chain.rootFrequency * chain.ratios[i];
+            chain.loudness[i] = Roughness::loudness(chain.amplitudes[i]);
+        }
+        for (size_t s = 0; s < shifts.size(); s++)
+        {
+            for (int i = 0; i < numberOfPartials; i++)
+                chain.shifted[i] = chain.frequencies[i] * shifts[s];
+            chain.terms[s] = Roughness::crossDissmeasure(chain.frequencies.data(), chain.loudness.data(), numberOfPartials,
+                                                         chain.shifted.data(), chain.loudness.data(), numberOfPartials);
+        }
+        chain.cost = getCost(chain.terms);
+    }
+
+    float getCost(const std::vector<float>& terms) const
+    {
+        const int numberOfStepTerms = numberOfSteps - 1;
+        float steps = 0.0f, midpoints = 0.0f;
+        for (int s = 0; s < numberOfStepTerms; s++)
+            steps += terms[s];
+        for (size_t s = (size_t)numberOfStepTerms; s < terms.size(); s++)
+            midpoints += terms[s];
+        return (steps / numberOfStepTerms) / std::max(midpoints / numberOfSteps, 1.0e-12f);
+    }
+
+    //dissonance of partial i with all partials shifted by s, and of all partials with partial i shifted, each pair once
+    float getContribution(Chain& chain, int i, float shift) const
+    {
+        for (int j = 0; j < numberOfPartials; j++)
+            chain.shifted[j] = chain.frequencies[j] * shift;
+        const float frequency = chain.frequencies[i];
+        const float shiftedFrequency = frequency * shift;
+        const float loudness = chain.loudness[i];
+        return Roughness::crossDissmeasure(&frequency, &loudness, 1, chain.shifted.data(), chain.loudness.data(), numberOfPartials)
+             + Roughness::crossDissmeasure(chain.frequencies.data(), chain.loudness.data(), numberOfPartials, &shiftedFrequency, &loudness, 1)
+             - Roughness::crossDissmeasure(&frequency, &loudness, 1, &shiftedFrequency, &loudness, 1);
+    }
+
+    template <typename ShouldStop>
+    void anneal(Chain& chain, ShouldStop& shouldStop) const
+    {
+        std::uniform_int_distribution<int> partial(1, numberOfPartials - 1);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        const float heat = std::sqrt(temperature / startTemperature); //big moves while hot, small ones at the end
+        const int moves = std::max(50, evaluationsPerRound / (int)shifts.size());
+
+        for (int move = 0; move < moves && ! shouldStop(); move++)
+        {
+            const int i = partial(chain.random);
+            for (size_t s = 0; s < shifts.size(); s++)
+                chain.newTerms[s] = chain.terms[s] - getContribution(chain, i, shifts[s]);
+
+            const float oldRatio = chain.ratios[i];
+            const float oldAmplitude = chain.amplitudes[i];
+            if (chain.random() % 4 != 0) //ratios are moved more often, they decide where the dips are
+            {
+                const float upper = i + 1 < numberOfPartials ? chain.ratios[i + 1] : chain.ratios[i] * 1.1f;
+                const float cents = (1.0f + 49.0f * heat) * unit(chain.random);
+                chain.ratios[i] = std::clamp(oldRatio * std::pow(2.0f, cents / 1200.0f), chain.ratios[i - 1], upper);
+                chain.frequencies[i] = chain.rootFrequency * chain.ratios[i];
+            }
+            else
+            {
+                chain.amplitudes[i] = std::clamp(oldAmplitude * std::pow(2.0f, 0.5f * heat * unit(chain.random)),
+                                                 0.5f * startAmplitudes[i], 1.5f * startAmplitudes[i]);
+                chain.loudness[i] = Roughness::loudness(chain.amplitudes[i]);
+            }
+
+            for (size_t s = 0; s < shifts.size(); s++)
+                chain.newTerms[s] += getContribution(chain, i, shifts[s]);
+            const float cost = getCost(chain.newTerms);
+
+            const float probability = std::uniform_real_distribution<float>(0.0f, 1.0f)(chain.random);
+            if (cost <= chain.cost || probability < std::exp((chain.cost - cost) / temperature))
+            {
+                chain.cost = cost;
+                std::swap(chain.terms, chain.newTerms);
+            }
+            else //back to where it was
+            {
+                chain.ratios[i] = oldRatio;
+                chain.amplitudes[i] = oldAmplitude;
+                chain.frequencies[i] = chain.rootFrequency * oldRatio;
+                chain.loudness[i] = Roughness::loudness(oldAmplitude);
+            }
+        }
+    }
+
+    int numberOfPartials = 0;
+    int numberOfSteps = 12;
+    std::vector<float> shifts;
+    std::vector<float> bestRatios;
+    std::vector<float> bestAmplitudes;
+    std::vector<float> startAmplitudes;
+    std::vector<Chain> chains;
+    float bestCost = 0.0f;
+    float startCost = 0.0f;
+    float startTemperature = 1.0f;
+    float temperature = 1.0f;
+    int rounds = 0;
+    WorkerPool* pool = nullptr;
+};
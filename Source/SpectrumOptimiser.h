@@ -0,0 +1,152 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <JuceHeader.h>
+#include "TripleBuffer.h"
+#include "SpectrumAnnealer.h"
+
+//where the optimisation starts, copied from the message thread
+struct OptimiserRequest
+{
+    bool active = false; //false => cancel
+    float root = 0.0f;
+    int notesPerOctave = 12;
+    std::vector<float> partialRatios;
+    std::vector<float> amplitudes;
+};
+
+struct OptimiserResult
+{
+    std::vector<float> partialRatios; //sorted by ratio
+    std::vector<float> amplitudes;
+    float cost = 0.0f; //relative to the start spectrum
+    int rounds = 0;
+    bool finished = false;
+    int generation = 0; //of the request it belongs to
+};
+
+/*  Runs a SpectrumAnnealer on a background thread, its chains on a WorkerPool
+    with half of the cores, so the dissonance analysis keeps up with the
+    spectrum while it changes.
+
+    start() posts a new start spectrum and cancel() stops the running
+    optimisation, both take effect within one move of the chains. The best
+    spectrum after each round is published through a TripleBuffer and the
+    listener is triggered on the message thread, so the spectrum can be shown
+    and played while it converges. Results of an older start() are dropped.
+*/
+class SpectrumOptimiser : private juce::Thread
+{
+public:
+    SpectrumOptimiser(juce::AsyncUpdater& listener)
+        : juce::Thread("Spectrum Optimiser"),
+          pool(juce::jmax(1, juce::SystemStats::getNumCpus() / 2 - 1)),
+          listener(listener)
+    {
+        annealer.setWorkerPool(&pool);
+        startThread();
+    }
+
+    ~SpectrumOptimiser() override
+    {
+        signalThreadShouldExit();
+        notify();
+        stopThread(2000);
+    }
+
+    //message thread only
+    void start(float root, int notesPerOctave, const std::vector<float>& partialRatios, const std::vector<float>& amplitudes, int numberOfPartials)
+    {
+        OptimiserRequest& request = requests.getWriteBuffer();
+        request.active = true;
+        request.root = root;
+        request.notesPerOctave = notesPerOctave;
+        request.partialRatios.assign(partialRatios.begin(), partialRatios.begin() + numberOfPartials);
+        request.amplitudes.assign(amplitudes.begin(), amplitudes.begin() + numberOfPartials);
+        post();
+    }
+
+    //message thread only
+    void cancel()
+    {
+        requests.getWriteBuffer().active = false;
+        post();
+    }
+
+    //message thread only => nullptr if there is no new result of the last start() since the last call
+    const OptimiserResult* getLatestResult()
+    {
+        if (! results.acquire() || results.getReadBuffer().generation != generation.load())
+            return nullptr;
+        return &results.getReadBuffer();
+    }
+
+private:
+    void post()
+    {
+        requests.publish();
+        generation++;
+        notify();
+    }
+
+    void run() override
+    {
+        int startedGeneration = 0;
+        while (! threadShouldExit())
+        {
+            if (generation.load() == startedGeneration)
+                wait(-1);
+
+            startedGeneration = generation.load();
+            if (threadShouldExit())
+                continue;
+
+            requests.acquire(); //keeps the last request if it was already picked up
+
+            const OptimiserRequest& request = requests.getReadBuffer();
+            if (! request.active)
+                continue;
+
+            auto shouldStop = [&] { return threadShouldExit() || generation.load() != startedGeneration; };
+            annealer.start(request.root, request.notesPerOctave, request.partialRatios.data(), request.amplitudes.data(),
+                           (int)request.partialRatios.size());
+            bool going = true;
+            while (going)
+            {
+                going = annealer.round(shouldStop);
+                if (shouldStop())
+                    break; //a newer request => this result is outdated
+
+                OptimiserResult& result = results.getWriteBuffer();
+                result.partialRatios = annealer.getRatios();
+                result.amplitudes = annealer.getAmplitudes();
+                result.cost = annealer.getStartCost() > 0.0f ? annealer.getCost() / annealer.getStartCost() : 1.0f;
+                result.rounds = annealer.getRounds();
+                result.finished = ! going;
+                result.generation = startedGeneration;
+                results.publish();
+                listener.triggerAsyncUpdate();
+            }
+        }
+    }
+
+    WorkerPool pool;
+    SpectrumAnnealer annealer;
+    TripleBuffer<OptimiserRequest> requests;
+    TripleBuffer<OptimiserResult> results;
+    std::atomic<int> generation { 0 }; //counts start() and cancel()
+    juce::AsyncUpdater& listener;
+
+    JUCE_DECLARE_NON_COPYABLE(SpectrumOptimiser)
+};
@@ -0,0 +1,91 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <cmath>
+#include <vector>
+
+/*  The spectra behind the spectrum buttons, without any Component, so the
+    offline renderer plays exactly what the app plays.
+*/
+namespace SpectrumPresets
+{
+    enum Id
+    {
+        sawtooth = 1,
+        square = 2,
+        triangle = 3,
+        random = 4,
+        equalTemperament = 5,
+        optimised = 6 //starts from equalTemperament, SpectrumOptimiser takes it from there
+    };
+
+    //fills all partials of partialRatios and amplitudes (same size), nextRandom() returns a float in [0, 1)
+    template <typename Random>
+    void calculate(int spectrumId, int numberOfPartials, int notesPerOct,
+                   std::vector<float>& partialRatios, std::vector<float>& amplitudes, Random&& nextRandom)
+    {
+        const int maxNumberOfPartials = (int)partialRatios.size();
+        if (spectrumId == sawtooth)
+        {
+            for (int i = 0; i < maxNumberOfPartials; ++i)
+            {
+                partialRatios[i] = i + 1.0f;
+                amplitudes[i] = 1.0f / (i + 1.0f);
+            }
+        }
+        else if (spectrumId == square)
+        {
+            for (int i = 0; i < maxNumberOfPartials; ++i)
+            {
+                partialRatios[i] = 2.0f * i + 1.0f;
+                amplitudes[i] = 1.0f / (i + 1.0f);
+            }
+        }
+        else if (spectrumId == triangle)
+        {
+            for (int i = 0; i < maxNumberOfPartials; ++i)
+            {
+                partialRatios[i] = 2.0f * i + 1.0f;
+                amplitudes[i] = 1.0f / std::pow(i + 1.0f, 2.0f);
+            }
+        }
+        else if (spectrumId == random)
+        {
+            for (int i = 0; i < maxNumberOfPartials; ++i)
+            {
+                partialRatios[i] = nextRandom() * numberOfPartials;
+                amplitudes[i] = nextRandom();
+            }
+        }
+        else if (spectrumId == equalTemperament || spectrumId == optimised) // optimize Spectrum for Equal Temperaments (Sethares p. 247)
+        {
+            const float s = std::pow(2.0f, 1.0f / notesPerOct);
+            for (int i = 0; i < maxNumberOfPartials; ++i)
+            {
+                float exponent = std::round(std::log10(i + 1.0f) / std::log10(s)); //s^x = z  =>  x = log(z)/log(s)
+                partialRatios[i] = std::pow(s, exponent);
+                amplitudes[i] = 1.0f / (i + 1.0f);
+            }
+        }
+    }
+
+    //output level for numberOfVoices sounding at once without clipping, only the first numberOfPartials play
+    inline float calculateLevel(const std::vector<float>& amplitudes, int numberOfPartials, int numberOfVoices)
+    {
+        float sumOfAmplitudes = 0.0f;
+        for (int i = 0; i < numberOfPartials && i < (int)amplitudes.size(); i++)
+            sumOfAmplitudes += amplitudes[i];
+        return 1.0f / (numberOfVoices * sumOfAmplitudes);
+    }
+}
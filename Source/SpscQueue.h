@@ -0,0 +1,58 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+/*  Wait-free first in, first out queue from one writer thread to one reader
+    thread, with a fixed capacity (a power of 2) and no allocation.
+
+    Unlike TripleBuffer every element arrives, so push() fails if the reader
+    falls behind by more than capacity elements.
+*/
+template <typename T, size_t capacity>
+class SpscQueue
+{
+public:
+    static_assert((capacity & (capacity - 1)) == 0, "capacity has to be a power of 2");
+
+    SpscQueue() {}
+
+    //writer only, returns false if the queue is full
+    bool push(const T& element) noexcept
+    {
+        const size_t write = writePosition.load(std::memory_order_relaxed);
+        if (write - readPosition.load(std::memory_order_acquire) == capacity)
+            return false;
+        elements[write & (capacity - 1)] = element;
+        writePosition.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    //reader only, returns false if the queue is empty
+    bool pop(T& element) noexcept
+    {
+        const size_t read = readPosition.load(std::memory_order_relaxed);
+        if (read == writePosition.load(std::memory_order_acquire))
+            return false;
+        element = elements[read & (capacity - 1)];
+        readPosition.store(read + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T elements[capacity];
+    alignas(64) std::atomic<size_t> writePosition { 0 };
+    alignas(64) std::atomic<size_t> readPosition { 0 };
+};
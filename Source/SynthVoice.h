@@ -0,0 +1,213 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <algorithm>
+#include <vector>
+#include "OscillatorBank.h"
+#include "SpectralSynth.h"
+
+/*  One finger: the partials of one note with a short attack/release ramp.
+
+    A voice whose finger is up and whose release has finished is inactive and
+    isn't rendered at all, so the cost follows the fingers that are down.
+    Partials at or above Nyquist are never rendered (they would only alias).
+
+    A new frequency while the voice sounds glides there over glideTime, a new
+    spectrum or level fades over the same time. Both are linear ramps inside the
+    OscillatorBank, so they are sample accurate wherever the caller splits the
+    block (e.g. at the offset of a touch event).
+*/
+class SynthVoice
+{
+public:
+    SynthVoice() {}
+
+    //allocates, call before the audio starts
+    void prepare(int newMaxNumberOfPartials, float newSampleRate)
+    {
+        maxNumberOfPartials = newMaxNumberOfPartials;
+        sampleRate = newSampleRate;
+        bank.setNumberOfOscillators(maxNumberOfPartials);
+        bank.setSampleRate(sampleRate);
+        attackStep = 1.0f / (attackTime * sampleRate);
+        releaseStep = 1.0f / (releaseTime * sampleRate);
+        glideSamples = std::max(1, (int)(glideTime * sampleRate));
+        gain = 0.0f;
+        targetGain = 0.0f;
+        frequencyRemaining = 0;
+        amplitudeRemaining = 0;
+        spectralSounding = false;
+        currentAmplitudes.assign((size_t)maxNumberOfPartials, 0.0f);
+        targetAmplitudes.assign((size_t)maxNumberOfPartials, 0.0f);
+        endAmplitudes.assign((size_t)maxNumberOfPartials, 0.0f);
+    }
+
+    //a new note right at its pitch, also when the voice is stolen while it still sounds
+    void start(float newFrequency) noexcept
+    {
+        frequency = newFrequency;
+        targetFrequency = newFrequency;
+        frequencyRemaining = 0;
+        targetGain = 1.0f;
+    }
+
+    //frequency <= 0 => the finger is up, the voice fades out with its last frequency
+    void setFrequency(float newFrequency) noexcept
+    {
+        if (newFrequency <= 0.0f)
+        {
+            targetGain = 0.0f;
+            return;
+        }
+        if (! isActive()) //a new note starts right at its pitch
+        {
+            frequency = newFrequency;
+            frequencyRemaining = 0;
+        }
+        else if (newFrequency != targetFrequency)
+        {
+            frequencyRemaining = glideSamples;
+        }
+        targetFrequency = newFrequency;
+        targetGain = 1.0f;
+    }
+
+    bool isActive() const noexcept { return gain > 0.0f || targetGain > 0.0f; }
+
+    //still has oscillators set in the SpectralSynth, which renderSpectral() has to silence
+    bool isSounding() const noexcept { return isActive() || spectralSounding; }
+
+    float getGain() const noexcept { return gain; }
+
+    //adds the voice to output, scratch needs numSamples floats
+    void render(float* output, float* scratch, int numSamples,
+                const float* partialRatios, const float* amplitudes, int numberOfPartials) noexcept
+    {
+        if (! isActive())
+            return;
+
+        setTargetAmplitudes(amplitudes, numberOfPartials);
+        for (int start = 0; start < numSamples;)
+        {
+            //up to the end of the block or of the next ramp, whichever comes first
+            int n = numSamples - start;
+            if (frequencyRemaining > 0)
+                n = std::min(n, frequencyRemaining);
+            if (amplitudeRemaining > 0)
+                n = std::min(n, amplitudeRemaining);
+            const bool ramping = frequencyRemaining > 0 || amplitudeRemaining > 0;
+
+            float endFrequency = targetFrequency;
+            if (frequencyRemaining > 0)
+                endFrequency = frequency + (targetFrequency - frequency) * n / frequencyRemaining;
+            for (int partial = 0; partial < maxNumberOfPartials; partial++)
+            {
+                endAmplitudes[partial] = amplitudeRemaining > 0 ? currentAmplitudes[partial] + (targetAmplitudes[partial] - currentAmplitudes[partial]) * n / amplitudeRemaining
+                                                                : targetAmplitudes[partial];
+            }
+
+            const float nyquist = 0.5f * sampleRate;
+            for (int partial = 0; partial < maxNumberOfPartials; partial++)
+            {
+                float f = endFrequency * partialRatios[partial];
+                bool audible = std::max(f, frequency * partialRatios[partial]) < nyquist;
+                bank.setOscillator(partial, f, audible ? endAmplitudes[partial] : 0.0f, ramping ? n : 0);
+            }
+
+            std::fill(scratch, scratch + n, 0.0f);
+            bank.render(scratch, n);
+            for (int sample = 0; sample < n; sample++)
+            {
+                output[start + sample] += gain * scratch[sample];
+                gain = targetGain > gain ? std::min(targetGain, gain + attackStep) : std::max(targetGain, gain - releaseStep);
+            }
+
+            frequency = endFrequency;
+            std::copy(endAmplitudes.begin(), endAmplitudes.end(), currentAmplitudes.begin());
+            frequencyRemaining = std::max(0, frequencyRemaining - n);
+            amplitudeRemaining = std::max(0, amplitudeRemaining - n);
+            start += n;
+        }
+    }
+
+    //same through the shared IFFT engine, gain, pitch and spectrum change once per block (the frames overlap anyway)
+    void renderSpectral(SpectralSynth& synth, int firstOscillator, int numSamples,
+                        const float* partialRatios, const float* amplitudes, int numberOfPartials) noexcept
+    {
+        if (! isActive())
+        {
+            if (spectralSounding) //silence it once, afterwards the voice costs nothing
+            {
+                for (int partial = 0; partial < maxNumberOfPartials; partial++)
+                    synth.setOscillator(firstOscillator + partial, 0.0f, 0.0f);
+                spectralSounding = false;
+            }
+            return;
+        }
+
+        setTargetAmplitudes(amplitudes, numberOfPartials);
+        std::copy(targetAmplitudes.begin(), targetAmplitudes.end(), currentAmplitudes.begin());
+        amplitudeRemaining = 0;
+        frequency = targetFrequency;
+        frequencyRemaining = 0;
+
+        float step = (targetGain > gain ? attackStep : releaseStep) * numSamples;
+        gain = targetGain > gain ? std::min(targetGain, gain + step) : std::max(targetGain, gain - step);
+        const float nyquist = 0.5f * sampleRate;
+        for (int partial = 0; partial < maxNumberOfPartials; partial++)
+        {
+            float f = frequency * partialRatios[partial];
+            synth.setOscillator(firstOscillator + partial, f, f < nyquist ? gain * currentAmplitudes[partial] : 0.0f);
+        }
+        spectralSounding = true;
+    }
+
+private:
+    //partials above numberOfPartials are silent, a change starts a fade
+    void setTargetAmplitudes(const float* amplitudes, int numberOfPartials) noexcept
+    {
+        bool changed = false;
+        for (int partial = 0; partial < maxNumberOfPartials; partial++)
+        {
+            float amplitude = partial < numberOfPartials ? amplitudes[partial] : 0.0f;
+            changed = changed || amplitude != targetAmplitudes[partial];
+            targetAmplitudes[partial] = amplitude;
+        }
+        if (changed)
+            amplitudeRemaining = gain > 0.0f ? glideSamples : 0; //a silent voice takes the new spectrum at once
+        if (amplitudeRemaining == 0)
+            std::copy(targetAmplitudes.begin(), targetAmplitudes.end(), currentAmplitudes.begin());
+    }
+
+    static constexpr float attackTime = 0.005f;
+    static constexpr float releaseTime = 0.02f;
+    static constexpr float glideTime = 0.005f;
+
+    OscillatorBank bank;
+    int maxNumberOfPartials = 0;
+    float sampleRate = 44100.0f;
+    float frequency = 0.0f;
+    float targetFrequency = 0.0f;
+    int frequencyRemaining = 0;
+    std::vector<float> currentAmplitudes;
+    std::vector<float> targetAmplitudes;
+    std::vector<float> endAmplitudes;
+    int amplitudeRemaining = 0;
+    int glideSamples = 1;
+    float gain = 0.0f;
+    float targetGain = 0.0f;
+    float attackStep = 0.0f;
+    float releaseStep = 0.0f;
+    bool spectralSounding = false;
+};
@@ -0,0 +1,56 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <atomic>
+
+/*  Wait-free handoff of a value from one writer thread to one reader thread.
+
+    The writer fills getWriteBuffer() and calls publish(), the reader calls
+    acquire() and then reads getReadBuffer(). Both sides always own a complete
+    buffer, a newer publish simply replaces an older one the reader hasn't picked
+    up yet (latest wins). The write buffer is not cleared between publishes, so
+    the writer has to fill in every field each time.
+*/
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() {}
+
+    T& getWriteBuffer() noexcept { return buffers[writeIndex]; }
+
+    void publish() noexcept
+    {
+        writeIndex = middle.exchange(writeIndex | newDataBit, std::memory_order_acq_rel) & indexMask;
+    }
+
+    //returns true if a newer buffer was published since the last call
+    bool acquire() noexcept
+    {
+        if ((middle.load(std::memory_order_relaxed) & newDataBit) == 0)
+            return false;
+        readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+
+    const T& getReadBuffer() const noexcept { return buffers[readIndex]; }
+
+private:
+    static constexpr int indexMask = 3;
+    static constexpr int newDataBit = 4;
+    T buffers[3];
+    int writeIndex = 0;
+    int readIndex = 1;
+    std::atomic<int> middle { 2 };
+};
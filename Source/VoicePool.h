@@ -0,0 +1,178 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <vector>
+#include "SynthVoice.h"
+
+/*  A fixed number of voices, allocated once in prepare(), shared by the fingers.
+
+    A finger that goes down gets a voice that is silent, otherwise the quietest
+    one that is fading out after its finger went up, otherwise the oldest one
+    that is still held. The voice only belongs to the finger until it goes up,
+    so its release can overlap with new notes.
+    Sounding voices are kept on a list, so rendering costs nothing for the
+    silent ones.
+    Everything after prepare() runs on the audio thread and doesn't allocate.
+*/
+class VoicePool
+{
+public:
+    VoicePool() {}
+
+    //allocates, call before the audio starts
+    //calling it again (e.g. when the audio device restarts) silences and rebuilds the pool in place
+    void prepare(int numberOfVoices, int numberOfFingers, int maxNumberOfPartials, float sampleRate)
+    {
+        voices.resize((size_t)numberOfVoices);
+        for (auto& voice : voices)
+            voice.prepare(maxNumberOfPartials, sampleRate);
+        partialsPerVoice = maxNumberOfPartials;
+        owners.assign((size_t)numberOfVoices, -1);
+        startedAt.assign((size_t)numberOfVoices, 0);
+        listed.assign((size_t)numberOfVoices, false);
+        fingerVoices.assign((size_t)numberOfFingers, -1);
+        sounding.clear();
+        sounding.reserve((size_t)numberOfVoices);
+        numberOfStartedNotes = 0;
+    }
+
+    int getNumberOfVoices() const noexcept { return (int)voices.size(); }
+
+    int getNumberOfSoundingVoices() const noexcept { return (int)sounding.size(); }
+
+    //frequency <= 0 => the finger went up
+    void setFingerFrequency(int finger, float frequency) noexcept
+    {
+        if (finger < 0 || finger >= (int)fingerVoices.size() || voices.empty())
+            return;
+
+        int index = fingerVoices[finger];
+        if (frequency <= 0.0f)
+        {
+            if (index >= 0)
+            {
+                voices[index].setFrequency(0.0f);
+                owners[index] = -1;
+                fingerVoices[finger] = -1;
+            }
+            return;
+        }
+        if (index >= 0)
+        {
+            voices[index].setFrequency(frequency);
+            return;
+        }
+
+        index = findVoiceToStart();
+        if (owners[index] >= 0) //stolen from a finger that is still down
+            fingerVoices[owners[index]] = -1;
+        owners[index] = finger;
+        fingerVoices[finger] = index;
+        startedAt[index] = ++numberOfStartedNotes;
+        voices[index].start(frequency);
+        if (! listed[index])
+        {
+            listed[index] = true;
+            sounding.push_back(index);
+        }
+    }
+
+    //all fingers at once, e.g. after touch events were lost
+    void setFingerFrequencies(const std::vector<float>& frequencies) noexcept
+    {
+        for (int finger = 0; finger < (int)frequencies.size(); finger++)
+            setFingerFrequency(finger, frequencies[finger]);
+    }
+
+    //adds the sounding voices to output, scratch needs numSamples floats
+    void render(float* output, float* scratch, int numSamples,
+                const float* partialRatios, const float* amplitudes, int numberOfPartials) noexcept
+    {
+        for (int item = 0; item < getNumberOfSoundingVoices(); item++)
+            renderSoundingVoice(item, output, scratch, numSamples, partialRatios, amplitudes, numberOfPartials);
+        removeSilentVoices();
+    }
+
+    //one voice of the sounding list, different items can render on different threads into different outputs
+    //=> call removeSilentVoices() once all of them are done
+    void renderSoundingVoice(int item, float* output, float* scratch, int numSamples,
+                             const float* partialRatios, const float* amplitudes, int numberOfPartials) noexcept
+    {
+        voices[sounding[item]].render(output, scratch, numSamples, partialRatios, amplitudes, numberOfPartials);
+    }
+
+    //voice i owns the oscillators from i * maxNumberOfPartials on
+    void renderSpectral(SpectralSynth& synth, int numSamples,
+                        const float* partialRatios, const float* amplitudes, int numberOfPartials) noexcept
+    {
+        for (int index : sounding)
+            voices[index].renderSpectral(synth, index * partialsPerVoice, numSamples, partialRatios, amplitudes, numberOfPartials);
+        removeSilentVoices();
+    }
+
+    //a voice stays listed until its release is over and the SpectralSynth has been silenced as well
+    void removeSilentVoices() noexcept
+    {
+        for (size_t i = 0; i < sounding.size();)
+        {
+            const int index = sounding[i];
+            if (owners[index] < 0 && ! voices[index].isSounding())
+            {
+                listed[index] = false;
+                sounding[i] = sounding.back();
+                sounding.pop_back();
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+private:
+    int findVoiceToStart() const noexcept
+    {
+        if (sounding.size() < voices.size())
+        {
+            for (int index = 0; index < (int)voices.size(); index++)
+                if (! listed[index])
+                    return index;
+        }
+
+        int quietest = -1;
+        int oldest = -1;
+        for (int index : sounding)
+        {
+            if (owners[index] < 0)
+            {
+                if (quietest < 0 || voices[index].getGain() < voices[quietest].getGain())
+                    quietest = index;
+            }
+            else if (oldest < 0 || startedAt[index] < startedAt[oldest])
+            {
+                oldest = index;
+            }
+        }
+        return quietest >= 0 ? quietest : oldest;
+    }
+
+    std::vector<SynthVoice> voices;
+    std::vector<int> owners; //finger of each voice, -1 => none
+    std::vector<unsigned long long> startedAt;
+    std::vector<bool> listed;
+    std::vector<int> fingerVoices; //voice of each finger, -1 => none
+    std::vector<int> sounding;
+    unsigned long long numberOfStartedNotes = 0;
+    int partialsPerVoice = 0;
+};
@@ -0,0 +1,154 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "AllocationCounter.h"
+
+/*  Small work-stealing pool for the analysis loops.
+
+    parallelFor() splits [0, n) into one contiguous range per worker. Every worker
+    takes chunks from the front of its own range and, once that is empty, steals
+    chunks from the ranges of the others, so uneven chunks still keep all cores
+    busy. The calling thread works as worker 0, the body gets the worker index to
+    pick its own scratch buffers.
+*/
+class WorkerPool
+{
+public:
+    //numberOfThreads < 1 => one thread per core besides the calling one
+    explicit WorkerPool(int numberOfThreads = 0)
+    {
+        if (numberOfThreads < 1)
+            numberOfThreads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+
+        ranges = std::vector<Range>((size_t)numberOfThreads + 1);
+        for (int i = 1; i <= numberOfThreads; i++)
+            threads.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            shouldExit = true;
+        }
+        wakeUp.notify_all();
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    int getNumberOfWorkers() const { return (int)ranges.size(); }
+
+    //calls body(begin, end, worker) for chunks of at most grain indices, returns when all are done
+    template <typename Body>
+    void parallelFor(int n, int grain, Body&& body)
+    {
+        if (n <= 0)
+            return;
+        grain = std::max(1, grain);
+        if (threads.empty() || n <= grain)
+        {
+            body(0, n, 0);
+            return;
+        }
+
+        std::lock_guard<std::mutex> jobLock(jobMutex); //one loop at a time
+        const int numberOfWorkers = getNumberOfWorkers();
+        for (int w = 0; w < numberOfWorkers; w++)
+        {
+            ranges[w].next.store((int)((long long)n * w / numberOfWorkers), std::memory_order_relaxed);
+            ranges[w].end = (int)((long long)n * (w + 1) / numberOfWorkers);
+        }
+        currentGrain = grain;
+        currentBody = &body;
+        invoke = [](void* b, int begin, int end, int worker) { (*static_cast<std::remove_reference_t<Body>*>(b))(begin, end, worker); };
+        busyWorkers.store(numberOfWorkers - 1, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            generation++;
+        }
+        wakeUp.notify_all();
+
+        work(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] { return busyWorkers.load(std::memory_order_acquire) == 0; });
+    }
+
+private:
+    struct alignas(64) Range //one cache line per range
+    {
+        std::atomic<int> next { 0 };
+        int end = 0;
+    };
+
+    void workerLoop(int worker)
+    {
+        AllocationCounter::watchCurrentThread(true);
+        unsigned long long seenGeneration = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [&] { return shouldExit || generation != seenGeneration; });
+                if (shouldExit)
+                    return;
+                seenGeneration = generation;
+            }
+
+            work(worker);
+
+            if (busyWorkers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.notify_all();
+            }
+        }
+    }
+
+    void work(int worker)
+    {
+        const int numberOfWorkers = getNumberOfWorkers();
+        for (int i = 0; i < numberOfWorkers; i++) //own range first, then steal from the others
+        {
+            Range& range = ranges[(worker + i) % numberOfWorkers];
+            for (;;)
+            {
+                int begin = range.next.fetch_add(currentGrain, std::memory_order_relaxed);
+                if (begin >= range.end)
+                    break;
+                invoke(currentBody, begin, std::min(begin + currentGrain, range.end), worker);
+            }
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<Range> ranges;
+    std::mutex jobMutex;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::condition_variable finished;
+    unsigned long long generation = 0;
+    bool shouldExit = false;
+    std::atomic<int> busyWorkers { 0 };
+    int currentGrain = 1;
+    void* currentBody = nullptr;
+    void (*invoke)(void*, int, int, int) = nullptr;
+};
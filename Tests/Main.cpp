@@ -0,0 +1,504 @@
+/*
+  ==============================================================================
+
+    Author:  Hannes Bradl, hbradl@gmx.at
+
+    This is free source code: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+  ==============================================================================
+*/
+
+/*  Correctness tests of ShadesCore, each against a slow reference:
+
+        kernels  every roughness kernel the CPU can run (SSE2, AVX2, NEON)
+                 against the scalar one, exact and fast mode, with tails and
+                 inactive partials
+        curve    FastCurve against the exact curve, within its documented error
+        pruning  critical band pruning against the sum over all pairs
+        matrix   DissonanceMatrix against crossDissmeasure/dissmeasure of the notes
+        map      DissonanceMapEngine after every one of a random sequence of finger
+                 moves (incremental chordCross) against dissmeasure of the chord
+        synth    SpectralSynth (inverse FFT) against OscillatorBank, the amplitude
+                 of every partial, and nothing else in its output
+
+    usage: Tests [kernels] [curve] [pruning] [matrix] [map] [synth]   (none => all)
+
+    Prints one line per check with the worst error and its limit, the exit code
+    is 1 if any check failed. The random spectra use fixed seeds.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "../Source/DissonanceMapEngine.h"
+#include "../Source/OscillatorBank.h"
+#include "../Source/SpectralSynth.h"
+
+namespace
+{
+    int failures = 0;
+
+    void report(const char* test, const std::string& check, double worst, double limit)
+    {
+        const bool ok = worst <= limit; //NaN fails too
+        std::printf("%-8s %-42s %s  worst %.3g, limit %.3g\n", test, check.c_str(), ok ? "ok  " : "FAIL", worst, limit);
+        if (! ok)
+            failures++;
+    }
+
+    //the terms are never negative => the error relative to the sum, absolute below 1
+    double relativeError(double value, double reference)
+    {
+        return std::abs(value - reference) / std::max(std::abs(reference), 1.0);
+    }
+
+    struct Partials
+    {
+        std::vector<float> freq, loud;
+    };
+
+    //n partials between 50 Hz and 12 kHz, every fifth one inactive if wanted
+    Partials randomPartials(std::mt19937& random, int n, bool sorted, bool withInactive)
+    {
+        std::uniform_real_distribution<float> octaves(0.0f, 7.9f), amplitude(0.01f, 1.0f);
+        Partials p;
+        for (int i = 0; i < n; i++)
+        {
+            p.freq.push_back(50.0f * std::pow(2.0f, octaves(random)));
+            p.loud.push_back(Roughness::loudness(amplitude(random)));
+        }
+        if (sorted)
+            std::sort(p.freq.begin(), p.freq.end());
+        if (withInactive)
+            for (int i = 2; i < n; i += 5)
+                p.freq[i] = -1.0f;
+        return p;
+    }
+
+    //sum of min(l_i, l_j) over all ordered pairs, the largest value the dissonance could have per unit of the curve
+    double loudnessOfPairs(const Partials& p)
+    {
+        double sum = 0.0;
+        for (size_t i = 0; i < p.freq.size(); i++)
+            for (size_t j = i + 1; j < p.freq.size(); j++)
+                if (p.freq[i] >= 0.0f && p.freq[j] >= 0.0f)
+                    sum += 2.0 * std::min(p.loud[i], p.loud[j]);
+        return sum;
+    }
+
+    //==========================================================================
+    void testKernels()
+    {
+        const std::vector<Roughness::Kernel> kernels = Roughness::getAvailableKernels();
+        const Roughness::Kernel& scalar = kernels[0];
+        std::string names;
+        for (const auto& kernel : kernels)
+            names += std::string(" ") + kernel.name;
+        std::printf("kernels:%s (used: %s)\n", names.c_str(), Roughness::getKernelName());
+
+        for (size_t k = 1; k < kernels.size(); k++)
+        {
+            const Roughness::Kernel& kernel = kernels[k];
+            for (int fast = 0; fast < 2; fast++)
+            {
+                std::mt19937 random(1);
+                double pairs = 0.0, cross = 0.0, row = 0.0;
+                for (int n : { 1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 64, 100, 257 })
+                {
+                    for (bool sorted : { false, true })
+                    {
+                        const Partials a = randomPartials(random, n, sorted, true);
+                        const Partials b = randomPartials(random, n + 5, sorted, true);
+                        pairs = std::max(pairs, relativeError(kernel.pairs[fast](a.freq.data(), a.loud.data(), n),
+                                                              scalar.pairs[fast](a.freq.data(), a.loud.data(), n)));
+                        cross = std::max(cross, relativeError(kernel.cross[fast](a.freq.data(), a.loud.data(), n, b.freq.data(), b.loud.data(), n + 5),
+                                                              scalar.cross[fast](a.freq.data(), a.loud.data(), n, b.freq.data(), b.loud.data(), n + 5)));
+                        for (int begin : { 0, 1, 3 })
+                            for (int i = 0; i < n; i++)
+                                row = std::max(row, relativeError(kernel.row[fast](a.freq[i], a.loud[i], b.freq.data(), b.loud.data(), begin, n + 5),
+                                                                  scalar.row[fast](a.freq[i], a.loud[i], b.freq.data(), b.loud.data(), begin, n + 5)));
+                    }
+                }
+                const std::string mode = fast ? " fast" : " exact";
+                const double limit = 1.0e-4; //float sums in another order, the polynomial exp of the vector paths
+                report("kernels", kernel.name + std::string(" pairs") + mode, pairs, limit);
+                report("kernels", kernel.name + std::string(" cross") + mode, cross, limit);
+                report("kernels", kernel.name + std::string(" row") + mode, row, limit);
+            }
+        }
+    }
+
+    //==========================================================================
+    void testCurve()
+    {
+        const Roughness::FastCurve& curve = Roughness::getFastCurve();
+        double worst = 0.0;
+        for (int i = 0; i <= 600000; i++)
+        {
+            const double x = i * 1.0e-5;
+            const double exact = std::exp(-Roughness::b1 * x) - std::exp(-Roughness::b2 * x);
+            worst = std::max(worst, std::abs(curve((float)x) - exact));
+        }
+        report("curve", "table vs exp, x in [0, 6]", worst, 1.0e-5);
+
+        //summed up, each pair is off by at most its loudness times the error of the curve
+        std::mt19937 random(2);
+        double dissonance = 0.0;
+        for (int n : { 10, 50, 200 })
+        {
+            const Partials p = randomPartials(random, n, true, false);
+            Roughness::setFastMode(true);
+            const float fast = Roughness::dissmeasure(p.freq.data(), p.loud.data(), n);
+            Roughness::setFastMode(false);
+            const float exact = Roughness::dissmeasure(p.freq.data(), p.loud.data(), n);
+            dissonance = std::max(dissonance, std::abs((double)fast - exact) / loudnessOfPairs(p));
+        }
+        report("curve", "dissmeasure fast vs exact / loudness", dissonance, 1.0e-5);
+    }
+
+    //==========================================================================
+    void testPruning()
+    {
+        //pruned pairs are more than 16 critical bandwidths apart, where the curve is below 1.5e-6
+        //=> the sum can't be off by more than 1.5e-6 per unit loudness of all pairs, plus the float rounding
+        const double limit = 2.0e-6;
+        std::mt19937 random(3);
+        double pairs = 0.0, cross = 0.0;
+        for (int n : { 5, 20, 100, 400 })
+        {
+            for (bool sorted : { false, true })
+            {
+                const Partials a = randomPartials(random, n, sorted, true);
+                const Partials b = randomPartials(random, n, sorted, true);
+                Partials both = a;
+                both.freq.insert(both.freq.end(), b.freq.begin(), b.freq.end());
+                both.loud.insert(both.loud.end(), b.loud.begin(), b.loud.end());
+
+                Roughness::setCriticalBandwidths(16.0f);
+                const float prunedPairs = Roughness::dissmeasure(a.freq.data(), a.loud.data(), n);
+                const float prunedCross = Roughness::crossDissmeasure(a.freq.data(), a.loud.data(), n, b.freq.data(), b.loud.data(), n);
+                Roughness::setCriticalBandwidths(0.0f);
+                const float allPairs = Roughness::dissmeasure(a.freq.data(), a.loud.data(), n);
+                const float allCross = Roughness::crossDissmeasure(a.freq.data(), a.loud.data(), n, b.freq.data(), b.loud.data(), n);
+
+                pairs = std::max(pairs, std::abs((double)prunedPairs - allPairs) / std::max(loudnessOfPairs(a), 1.0));
+                cross = std::max(cross, std::abs((double)prunedCross - allCross) / std::max(loudnessOfPairs(both), 1.0));
+            }
+        }
+        Roughness::setCriticalBandwidths(16.0f);
+        report("pruning", "dissmeasure / loudness", pairs, limit);
+        report("pruning", "crossDissmeasure / loudness", cross, limit);
+    }
+
+    //==========================================================================
+    //ratios in random order, harmonic or not
+    void randomSpectrum(std::mt19937& random, int n, bool harmonic, std::vector<float>& ratios, std::vector<float>& amplitudes)
+    {
+        std::uniform_real_distribution<float> ratio(1.0f, 12.0f), amplitude(0.05f, 1.0f);
+        ratios.clear();
+        amplitudes.clear();
+        for (int i = 0; i < n; i++)
+        {
+            ratios.push_back(harmonic ? i + 1.0f : (i == 0 ? 1.0f : ratio(random)));
+            amplitudes.push_back(harmonic ? 1.0f / (i + 1.0f) : amplitude(random));
+        }
+        std::shuffle(ratios.begin(), ratios.end(), random);
+    }
+
+    //all partials of the notes (intervals above root) in one spectrum
+    Partials chord(float root, const std::vector<float>& intervals, const std::vector<float>& ratios, const std::vector<float>& loudness)
+    {
+        Partials p;
+        for (float interval : intervals)
+        {
+            if (interval <= 0.0f)
+                continue;
+            for (size_t j = 0; j < ratios.size(); j++)
+            {
+                p.freq.push_back(root * ratios[j] * interval);
+                p.loud.push_back(loudness[j]);
+            }
+        }
+        return p;
+    }
+
+    float dissmeasure(const Partials& p)
+    {
+        return Roughness::dissmeasure(p.freq.data(), p.loud.data(), (int)p.freq.size());
+    }
+
+    void testMatrix()
+    {
+        const float root = 110.0f;
+        const int notesPerOctave = 12, numberOfNotes = 36;
+        WorkerPool pool(3);
+        std::mt19937 random(4);
+        for (bool harmonic : { true, false })
+        {
+            for (WorkerPool* workers : { (WorkerPool*)nullptr, &pool })
+            {
+                std::vector<float> ratios, amplitudes, loudness;
+                randomSpectrum(random, 10, harmonic, ratios, amplitudes);
+                for (float amplitude : amplitudes)
+                    loudness.push_back(Roughness::loudness(amplitude));
+
+                DissonanceMatrix matrix;
+                matrix.setWorkerPool(workers);
+                matrix.configure(root, notesPerOctave, numberOfNotes, ratios, loudness);
+
+                auto note = [&](float interval) { return chord(root, { interval }, ratios, loudness); };
+                auto interval = [&](int n) { return std::pow(2.0f, (float)n / notesPerOctave); };
+
+                double self = 0.0, table = 0.0, offGrid = 0.0, index = 0.0;
+                for (int a = 0; a < numberOfNotes; a++)
+                {
+                    const Partials pa = note(interval(a));
+                    self = std::max(self, relativeError(matrix.getSelf(a), dissmeasure(pa)));
+                    for (int b : { 0, 1, 5, 7, 12, 19, 24, 35 }) //rows in mixed order => mirrored and fresh entries
+                    {
+                        const Partials pb = note(interval(b));
+                        const float reference = Roughness::crossDissmeasure(pa.freq.data(), pa.loud.data(), (int)pa.freq.size(),
+                                                                             pb.freq.data(), pb.loud.data(), (int)pb.freq.size());
+                        table = std::max(table, relativeError(matrix.get(a, b), reference));
+                        table = std::max(table, relativeError(matrix.get(b, a), reference));
+                    }
+                    index = std::max(index, (double)std::abs(matrix.getNoteIndex(interval(a)) - a));
+                }
+
+                std::vector<float> row((size_t)numberOfNotes);
+                for (float cents : { 50.0f, 733.0f, 1999.0f })
+                {
+                    const float offGridInterval = std::pow(2.0f, cents / 1200.0f);
+                    index = std::max(index, matrix.getNoteIndex(offGridInterval) == -1 ? 0.0 : 1.0);
+                    matrix.computeRow(offGridInterval, row.data());
+                    const Partials pa = note(offGridInterval);
+                    for (int b = 0; b < numberOfNotes; b++)
+                    {
+                        const Partials pb = note(interval(b));
+                        offGrid = std::max(offGrid, relativeError(row[b], Roughness::crossDissmeasure(pa.freq.data(), pa.loud.data(), (int)pa.freq.size(),
+                                                                                                     pb.freq.data(), pb.loud.data(), (int)pb.freq.size())));
+                    }
+                    const Partials pc = note(1.37f);
+                    offGrid = std::max(offGrid, relativeError(matrix.computeCross(offGridInterval, 1.37f),
+                                                              Roughness::crossDissmeasure(pa.freq.data(), pa.loud.data(), (int)pa.freq.size(),
+                                                                                          pc.freq.data(), pc.loud.data(), (int)pc.freq.size())));
+                }
+
+                const std::string what = std::string(harmonic ? "harmonic" : "inharmonic") + (workers != nullptr ? ", pool" : "");
+                report("matrix", "getSelf, " + what, self, 1.0e-4);
+                report("matrix", "get, " + what, table, 1.0e-4);
+                report("matrix", "computeRow/Cross, " + what, offGrid, 1.0e-4);
+                report("matrix", "getNoteIndex, " + what, index, 0.0);
+            }
+        }
+    }
+
+    //==========================================================================
+    void testMap()
+    {
+        const float root = 110.0f;
+        const int notesPerOctave = 12, octaves = 2, numberOfFingers = 10;
+        WorkerPool pool(3);
+        for (WorkerPool* workers : { (WorkerPool*)nullptr, &pool })
+        {
+            std::mt19937 random(5);
+            std::vector<float> ratios, amplitudes, loudness;
+            randomSpectrum(random, 8, false, ratios, amplitudes);
+
+            DissonanceMapEngine engine(numberOfFingers);
+            engine.setWorkerPool(workers);
+            engine.prepare(16, notesPerOctave * octaves);
+            engine.setGrid(root, notesPerOctave, octaves);
+
+            std::vector<float> intervals((size_t)numberOfFingers, 0.0f);
+            std::uniform_int_distribution<int> finger(0, numberOfFingers - 1), action(0, 3), step(0, notesPerOctave * octaves - 1);
+            std::uniform_real_distribution<float> cents(0.0f, 1200.0f * octaves);
+            double current = 0.0, map = 0.0, unchanged = 0.0;
+            for (int move = 0; move < 120; move++)
+            {
+                if (move % 40 == 0) //new spectrum => the matrix and the chord are rebuilt
+                {
+                    randomSpectrum(random, 8, move == 40, ratios, amplitudes);
+                    loudness.clear();
+                    for (float amplitude : amplitudes)
+                        loudness.push_back(Roughness::loudness(amplitude));
+                    engine.setSpectrum(ratios, amplitudes);
+                }
+
+                const int k = finger(random);
+                switch (action(random))
+                {
+                    case 0:  intervals[k] = 0.0f; break; //up
+                    case 1:  intervals[k] = std::pow(2.0f, cents(random) / 1200.0f); break; //off the grid
+                    default: intervals[k] = std::pow(2.0f, (float)step(random) / notesPerOctave); break;
+                }
+                engine.setIntervals(intervals);
+                engine.update();
+                unchanged = std::max(unchanged, engine.update() ? 1.0 : 0.0);
+
+                const Partials held = chord(root, intervals, ratios, loudness);
+                current = std::max(current, relativeError(engine.getCurrentDissonance(), dissmeasure(held)));
+
+                //the map is held chord + each note, normalised to 0...1
+                std::vector<float> reference;
+                for (int n = 0; n < notesPerOctave * octaves; n++)
+                {
+                    Partials p = held;
+                    const Partials candidate = chord(root, { std::pow(2.0f, (float)n / notesPerOctave) }, ratios, loudness);
+                    p.freq.insert(p.freq.end(), candidate.freq.begin(), candidate.freq.end());
+                    p.loud.insert(p.loud.end(), candidate.loud.begin(), candidate.loud.end());
+                    reference.push_back(dissmeasure(p));
+                }
+                const float minimum = *std::min_element(reference.begin(), reference.end());
+                const float range = *std::max_element(reference.begin(), reference.end()) - minimum;
+                for (size_t n = 0; n < reference.size(); n++)
+                    map = std::max(map, (double)std::abs(engine.getDissonances()[n] - (reference[n] - minimum) / range));
+            }
+
+            const std::string what = workers != nullptr ? ", pool" : "";
+            report("map", "current dissonance" + what, current, 1.0e-4);
+            report("map", "normalised map" + what, map, 1.0e-3);
+            report("map", "second update() returns false" + what, unchanged, 0.0);
+        }
+    }
+
+    //==========================================================================
+    //amplitude of the sinusoid at frequency in signal, squared Hann window => the other partials don't leak in
+    double amplitudeAt(const std::vector<float>& signal, double frequency, double sampleRate)
+    {
+        const double pi = 3.14159265358979323846;
+        const size_t n = signal.size();
+        std::complex<double> sum;
+        double windowSum = 0.0;
+        for (size_t i = 0; i < n; i++)
+        {
+            const double hann = 0.5 - 0.5 * std::cos(2.0 * pi * i / n);
+            sum += hann * hann * (double)signal[i] * std::polar(1.0, -2.0 * pi * frequency * i / sampleRate);
+            windowSum += hann * hann;
+        }
+        return 2.0 * std::abs(sum) / windowSum;
+    }
+
+    //mean power with the same window, the cross terms of the partials cancel => sum of amplitude^2 / 2 plus
+    //whatever else is in the signal
+    double powerOf(const std::vector<float>& signal)
+    {
+        const double pi = 3.14159265358979323846;
+        const size_t n = signal.size();
+        double sum = 0.0, windowSum = 0.0;
+        for (size_t i = 0; i < n; i++)
+        {
+            const double hann = 0.5 - 0.5 * std::cos(2.0 * pi * i / n);
+            sum += hann * hann * (double)signal[i] * signal[i];
+            windowSum += hann * hann;
+        }
+        return sum / windowSum;
+    }
+
+    void testSynth()
+    {
+        const float sampleRate = 48000.0f;
+        const int blockSize = 512, settle = 4 * SpectralSynth::frameSize, length = 16384;
+        std::mt19937 random(6);
+        for (bool harmonic : { true, false })
+        {
+            //at least 60 Hz apart => 20 bins of the analysis window
+            std::vector<float> frequencies, amplitudes;
+            std::uniform_real_distribution<float> octaves(0.0f, 7.0f), amplitude(0.01f, 0.5f);
+            while (frequencies.size() < 24)
+            {
+                const float f = harmonic ? 220.0f * (frequencies.size() + 1) : 100.0f * std::pow(2.0f, octaves(random));
+                if (std::all_of(frequencies.begin(), frequencies.end(), [f](float g) { return std::abs(f - g) >= 60.0f; }))
+                {
+                    frequencies.push_back(f);
+                    amplitudes.push_back(harmonic ? 0.5f / frequencies.size() : amplitude(random));
+                }
+            }
+
+            OscillatorBank bank;
+            SpectralSynth synth;
+            bank.setNumberOfOscillators((int)frequencies.size());
+            synth.setNumberOfOscillators((int)frequencies.size());
+            bank.setSampleRate(sampleRate);
+            synth.setSampleRate(sampleRate);
+            for (int i = 0; i < (int)frequencies.size(); i++)
+            {
+                bank.setOscillator(i, frequencies[i], amplitudes[i]);
+                synth.setOscillator(i, frequencies[i], amplitudes[i]);
+            }
+
+            std::vector<float> bankOut((size_t)(settle + length), 0.0f), synthOut((size_t)(settle + length), 0.0f);
+            for (int start = 0; start < settle + length; start += blockSize)
+            {
+                bank.render(bankOut.data() + start, std::min(blockSize, settle + length - start));
+                synth.render(synthOut.data() + start, std::min(blockSize, settle + length - start));
+            }
+            bankOut.erase(bankOut.begin(), bankOut.begin() + settle);
+            synthOut.erase(synthOut.begin(), synthOut.begin() + settle);
+
+            //relative to the loudest partial => -60 dB
+            const float loudest = *std::max_element(amplitudes.begin(), amplitudes.end());
+            double againstBank = 0.0, againstSet = 0.0;
+            for (size_t i = 0; i < frequencies.size(); i++)
+            {
+                const double fromBank = amplitudeAt(bankOut, frequencies[i], sampleRate);
+                const double fromSynth = amplitudeAt(synthOut, frequencies[i], sampleRate);
+                againstBank = std::max(againstBank, std::abs(fromSynth - fromBank) / loudest);
+                againstSet = std::max(againstSet, std::abs(fromBank - amplitudes[i]) / loudest);
+            }
+
+            double expectedPower = 0.0;
+            for (float a : amplitudes)
+                expectedPower += 0.5 * a * a;
+
+            const std::string what = harmonic ? ", harmonic" : ", inharmonic";
+            report("synth", "oscillator bank vs amplitudes" + what, againstSet, 1.0e-3);
+            report("synth", "ifft vs oscillator bank" + what, againstBank, 1.0e-3);
+            report("synth", "ifft rms vs amplitudes" + what, std::abs(std::sqrt(powerOf(synthOut) / expectedPower) - 1.0), 1.0e-3);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const std::vector<std::string> tests { "kernels", "curve", "pruning", "matrix", "map", "synth" };
+    std::vector<std::string> selected(argv + 1, argv + argc);
+    for (const auto& test : selected)
+    {
+        if (std::find(tests.begin(), tests.end(), test) == tests.end())
+        {
+            std::fprintf(stderr, "usage: %s [kernels] [curve] [pruning] [matrix] [map] [synth]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (selected.empty())
+        selected = tests;
+
+    auto run = [&](const char* test) { return std::find(selected.begin(), selected.end(), test) != selected.end(); };
+    if (run("kernels"))
+        testKernels();
+    if (run("curve"))
+        testCurve();
+    if (run("pruning"))
+        testPruning();
+    if (run("matrix"))
+        testMatrix();
+    if (run("map"))
+        testMap();
+    if (run("synth"))
+        testSynth();
+
+    if (failures > 0)
+    {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}